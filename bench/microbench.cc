@@ -0,0 +1,297 @@
+// Per-function microbenchmarks for the client and server hot paths.
+//
+//   ./fc_kv_microbench --benchmark_filter=CheckCompatability
+//
+// Server handlers are called in-process on a FCKVStoreRPCServiceImpl backed
+// by the memory engine, so the numbers exclude gRPC and the network.
+#include "chunker.h"
+#include "customer.h"
+#include "server.h"
+
+#include <benchmark/benchmark.h>
+#include <openssl/sha.h>
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+static std::string RandomBytes(std::mt19937_64& rng, size_t len) {
+  std::string value(len, '\0');
+  for (auto& c : value) c = (char)rng();
+  return value;
+}
+
+// A realistic version struct for a group of num_users users: a PEM sized
+// pubkey, a full version vector and an RSA-2048 sized signature.
+static VersionStruct MakeVersionStruct(std::mt19937_64& rng, int version, int num_users) {
+  VersionStruct v;
+  v.set_version(version);
+  v.set_pubkey(RandomBytes(rng, 426));
+  v.set_itablehash(rng());
+  for (int i = 0; i < num_users; i++) {
+    auto* uv = v.add_vlist();
+    uv->set_user(rng());
+    uv->set_version(i + 1);
+  }
+  v.set_signature(RandomBytes(rng, 256));
+  return v;
+}
+
+static KeyTable MakeKeyTable(std::mt19937_64& rng, int num_keys) {
+  KeyTable table;
+  for (int i = 0; i < num_keys; i++) {
+    (*table.mutable_table())[rng()] = rng();
+  }
+  return table;
+}
+
+// Key files for signVersionStruct, generated once by constructing a client.
+// The channel is never used, connecting is lazy.
+static const std::string& PrivateKeyFile() {
+  static std::string privateKeyFile = [] {
+    std::string dir = std::filesystem::temp_directory_path();
+    std::string priv = dir + "/microbench_private_key.pem";
+    std::string pub = dir + "/microbench_public_key.pem";
+    FCKVClient client(grpc::CreateChannel("localhost:1", grpc::InsecureChannelCredentials()),
+                      "microbench", priv, pub);
+    return priv;
+  }();
+  return privateKeyFile;
+}
+
+/////////////////// client ///////////////////
+
+static void BM_SignVersionStruct(benchmark::State& state) {
+  std::mt19937_64 rng(1);
+  VersionStruct v = MakeVersionStruct(rng, 1, state.range(0));
+  const std::string& keyFile = PrivateKeyFile();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(signVersionStruct(&v, keyFile));
+  }
+}
+BENCHMARK(BM_SignVersionStruct)->Arg(2)->Arg(64)->Unit(benchmark::kMicrosecond);
+
+static void BM_VerifyVersionStruct(benchmark::State& state) {
+  std::mt19937_64 rng(1);
+  VersionStruct v = MakeVersionStruct(rng, 1, state.range(0));
+  const std::string& keyFile = PrivateKeyFile();
+  std::string publicKeyFile = std::filesystem::path(keyFile).parent_path() / "microbench_public_key.pem";
+  std::ifstream in(publicKeyFile);
+  v.set_pubkey(std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()));
+  signVersionStruct(&v, keyFile);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(verifyVersionStruct(v));
+  }
+}
+BENCHMARK(BM_VerifyVersionStruct)->Arg(2)->Arg(64)->Unit(benchmark::kMicrosecond);
+
+static void BM_CheckCompatability(benchmark::State& state) {
+  std::mt19937_64 rng(1);
+  std::vector<VersionStruct> versions;
+  for (int i = 0; i < state.range(0); i++) {
+    versions.push_back(MakeVersionStruct(rng, state.range(0) - i, state.range(0)));
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(FCKVClient::CheckCompatability(versions));
+  }
+  state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_CheckCompatability)->RangeMultiplier(4)->Range(2, 512)->Complexity();
+
+static void BM_KeyTableSerialize(benchmark::State& state) {
+  std::mt19937_64 rng(1);
+  KeyTable table = MakeKeyTable(rng, state.range(0));
+  std::string out;
+  for (auto _ : state) {
+    table.SerializeToString(&out);
+    benchmark::DoNotOptimize(out);
+  }
+  state.SetBytesProcessed(state.iterations() * out.size());
+}
+BENCHMARK(BM_KeyTableSerialize)->RangeMultiplier(8)->Range(8, 32768);
+
+static void BM_KeyTableParse(benchmark::State& state) {
+  std::mt19937_64 rng(1);
+  std::string serialized = MakeKeyTable(rng, state.range(0)).SerializeAsString();
+  KeyTable table;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(table.ParseFromString(serialized));
+  }
+  state.SetBytesProcessed(state.iterations() * serialized.size());
+}
+BENCHMARK(BM_KeyTableParse)->RangeMultiplier(8)->Range(8, 32768);
+
+static void BM_VersionStructSerialize(benchmark::State& state) {
+  std::mt19937_64 rng(1);
+  VersionStruct v = MakeVersionStruct(rng, 1, state.range(0));
+  std::string out;
+  for (auto _ : state) {
+    v.SerializeToString(&out);
+    benchmark::DoNotOptimize(out);
+  }
+}
+BENCHMARK(BM_VersionStructSerialize)->RangeMultiplier(8)->Range(2, 512);
+
+static void BM_VersionStructParse(benchmark::State& state) {
+  std::mt19937_64 rng(1);
+  std::string serialized = MakeVersionStruct(rng, 1, state.range(0)).SerializeAsString();
+  VersionStruct v;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(v.ParseFromString(serialized));
+  }
+}
+BENCHMARK(BM_VersionStructParse)->RangeMultiplier(8)->Range(2, 512);
+
+static void BM_ChunkerSplit(benchmark::State& state) {
+  std::mt19937_64 rng(1);
+  std::string value = RandomBytes(rng, state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Chunker::Split(value));
+  }
+  state.SetBytesProcessed(state.iterations() * value.size());
+}
+BENCHMARK(BM_ChunkerSplit)->Arg(Chunker::kChunkThreshold)->Arg(16 << 20);
+
+/////////////////// hashing ///////////////////
+
+static uint64_t Fnv1a64(const std::string& s) {
+  uint64_t h = 14695981039346656037ULL;
+  for (unsigned char c : s) {
+    h ^= c;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static void BM_HashStd(benchmark::State& state) {
+  std::mt19937_64 rng(1);
+  std::string value = RandomBytes(rng, state.range(0));
+  std::hash<std::string> hasher;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(hasher(value));
+  }
+  state.SetBytesProcessed(state.iterations() * value.size());
+}
+BENCHMARK(BM_HashStd)->RangeMultiplier(16)->Range(16, 1 << 20);
+
+static void BM_HashFnv1a(benchmark::State& state) {
+  std::mt19937_64 rng(1);
+  std::string value = RandomBytes(rng, state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Fnv1a64(value));
+  }
+  state.SetBytesProcessed(state.iterations() * value.size());
+}
+BENCHMARK(BM_HashFnv1a)->RangeMultiplier(16)->Range(16, 1 << 20);
+
+static void BM_HashSha256(benchmark::State& state) {
+  std::mt19937_64 rng(1);
+  std::string value = RandomBytes(rng, state.range(0));
+  unsigned char digest[SHA256_DIGEST_LENGTH];
+  for (auto _ : state) {
+    SHA256((const unsigned char*)value.data(), value.size(), digest);
+    benchmark::DoNotOptimize(digest);
+  }
+  state.SetBytesProcessed(state.iterations() * value.size());
+}
+BENCHMARK(BM_HashSha256)->RangeMultiplier(16)->Range(16, 1 << 20);
+
+/////////////////// server ///////////////////
+
+static const uint64_t kBenchPubkey = 1;
+
+// in-process service on the memory engine, holding the global lock for us
+static std::unique_ptr<FCKVStoreRPCServiceImpl> LockedService(size_t cache_bytes) {
+  auto service = std::make_unique<FCKVStoreRPCServiceImpl>("memory", "", cache_bytes);
+  ServerContext context;
+  StartOpRequest req;
+  StartOpResponse res;
+  req.set_pubkey(kBenchPubkey);
+  service->FCKVStoreStartOp(&context, &req, &res);
+  return service;
+}
+
+// cycles through a fixed set of values, so the memory engine holds at most
+// kPutValues of them however many iterations run
+static void BM_ServerPut(benchmark::State& state) {
+  const int kPutValues = 64;
+  auto service = LockedService(BlobCache::kDefaultCapacityBytes);
+  std::mt19937_64 rng(1);
+  std::vector<PutRequest> reqs(kPutValues);
+  for (auto& req : reqs) {
+    req.set_pubkey(kBenchPubkey);
+    req.set_value(RandomBytes(rng, state.range(0)));
+  }
+  PutResponse reply;
+  size_t i = 0;
+  for (auto _ : state) {
+    ServerContext context;
+    service->FCKVStorePut(&context, &reqs[i++ % reqs.size()], &reply);
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ServerPut)->RangeMultiplier(16)->Range(64, 1 << 20);
+
+// args: value size, cache on (1) or off (0)
+static void BM_ServerGet(benchmark::State& state) {
+  auto service = LockedService(state.range(1) ? BlobCache::kDefaultCapacityBytes : 0);
+  std::mt19937_64 rng(1);
+  std::vector<uint64_t> keys;
+  for (int i = 0; i < 64; i++) {
+    ServerContext context;
+    PutRequest req;
+    PutResponse reply;
+    req.set_pubkey(kBenchPubkey);
+    req.set_value(RandomBytes(rng, state.range(0)));
+    service->FCKVStorePut(&context, &req, &reply);
+    keys.push_back(reply.hash());
+  }
+
+  GetRequest req;
+  req.set_pubkey(kBenchPubkey);
+  GetResponse reply;
+  size_t i = 0;
+  for (auto _ : state) {
+    ServerContext context;
+    req.set_key(keys[i++ % keys.size()]);
+    service->FCKVStoreGet(&context, &req, &reply);
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ServerGet)->ArgsProduct({{64, 4 << 10, 256 << 10}, {0, 1}});
+
+// one StartOp + CommitOp round against a version list of num_users users
+static void BM_ServerStartCommit(benchmark::State& state) {
+  auto service = std::make_unique<FCKVStoreRPCServiceImpl>("memory", "", 0);
+  std::mt19937_64 rng(1);
+  for (int u = 0; u < state.range(0); u++) {
+    ServerContext context;
+    StartOpRequest sreq;
+    StartOpResponse sres;
+    CommitOpRequest creq;
+    CommitOpResponse cres;
+    sreq.set_pubkey(u + 1);
+    service->FCKVStoreStartOp(&context, &sreq, &sres);
+    creq.set_pubkey(u + 1);
+    *creq.mutable_v() = MakeVersionStruct(rng, u + 1, state.range(0));
+    service->FCKVStoreCommitOp(&context, &creq, &cres);
+  }
+
+  StartOpRequest sreq;
+  sreq.set_pubkey(1);
+  CommitOpRequest creq;
+  creq.set_pubkey(1);
+  *creq.mutable_v() = MakeVersionStruct(rng, state.range(0) + 1, state.range(0));
+  for (auto _ : state) {
+    ServerContext context;
+    StartOpResponse sres;
+    CommitOpResponse cres;
+    service->FCKVStoreStartOp(&context, &sreq, &sres);
+    service->FCKVStoreCommitOp(&context, &creq, &cres);
+  }
+}
+BENCHMARK(BM_ServerStartCommit)->RangeMultiplier(4)->Range(2, 512);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,76 @@
+#include "admission.h"
+
+#include <algorithm>
+
+AdmissionController::AdmissionController(size_t max_in_flight)
+  : max_in_flight_(max_in_flight) {
+}
+
+AdmissionController::Ticket::Ticket(AdmissionController* controller, RpcType type,
+                                    Clock::time_point deadline)
+  : controller_(controller),
+    type_(type),
+    start_(Clock::now()) {
+  PerType& t = controller_->types_[type_];
+  if (!Sheddable(type_)) {
+    t.in_flight++;
+    return;
+  }
+
+  // without a deadline, gRPC reports Clock::time_point::max()
+  if (deadline != Clock::time_point::max()) {
+    auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - start_);
+    if (remaining.count() <= 0 || (uint64_t)remaining.count() < t.service_us) {
+      t.expired++;
+      // pull the estimate toward the budget, so one slow spell cannot lock
+      // out short deadlines forever; the next admitted request corrects it
+      if (remaining.count() > 0) {
+        controller_->RecordServiceTime(type_, remaining.count());
+      }
+      status_ = grpc::Status(grpc::StatusCode::DEADLINE_EXCEEDED, "deadline cannot be met");
+      return;
+    }
+  }
+
+  uint64_t before = t.in_flight.fetch_add(1);
+  if (controller_->max_in_flight_ && before >= controller_->max_in_flight_) {
+    t.in_flight--;
+    t.shed++;
+    // about how long until a slot frees up: one service time, at least 1ms
+    retry_after_ms_ = std::max<uint64_t>(1, t.service_us / 1000);
+    status_ = grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED, "server overloaded");
+    return;
+  }
+}
+
+AdmissionController::Ticket::~Ticket() {
+  if (!admitted()) {
+    return;
+  }
+  auto us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start_);
+  controller_->RecordServiceTime(type_, std::max<int64_t>(0, us.count()));
+  controller_->types_[type_].in_flight--;
+}
+
+void AdmissionController::RecordServiceTime(RpcType type, uint64_t us) {
+  // lossy under races, which is fine for an estimate
+  std::atomic<uint64_t>& ewma = types_[type].service_us;
+  uint64_t old = ewma.load(std::memory_order_relaxed);
+  ewma.store(old ? old - old / 8 + us / 8 : us, std::memory_order_relaxed);
+}
+
+uint64_t AdmissionController::shed() const {
+  uint64_t total = 0;
+  for (auto& t : types_) {
+    total += t.shed;
+  }
+  return total;
+}
+
+uint64_t AdmissionController::expired() const {
+  uint64_t total = 0;
+  for (auto& t : types_) {
+    total += t.expired;
+  }
+  return total;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <grpcpp/grpcpp.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Admission control in front of the FCKVStoreRPCServiceImpl handlers.
+//
+// Each RPC type has a cap on requests in flight. A request over the cap is
+// shed with RESOURCE_EXHAUSTED before it does any work, along with a
+// retry-after hint (kRetryAfterMetadataKey trailing metadata) that the
+// client backs off by. A request whose deadline has already passed, or is
+// closer than the measured service time of its type, is dropped with
+// DEADLINE_EXCEEDED, since the client would give up on the answer anyway.
+// Service times are an EWMA over admitted requests of that type.
+//
+// CommitOp and AbortOp are always admitted (and still counted): they release
+// a namespace lock, and dropping one would leave the namespace locked.
+class AdmissionController
+{
+public:
+  enum RpcType { kStartOp, kCommitOp, kAbortOp, kGet, kPut, kHasBlobs, kNumRpcTypes };
+
+  using Clock = std::chrono::system_clock;   // ServerContext::deadline()'s clock
+
+  static constexpr const char* kRetryAfterMetadataKey = "fc-retry-after-ms";
+  static constexpr size_t kDefaultMaxInFlight = 64;   // per RPC type, 0 disables the cap
+
+  explicit AdmissionController(size_t max_in_flight = kDefaultMaxInFlight);
+
+  // false for the lock-releasing RPCs, which are never shed or dropped
+  static bool Sheddable(RpcType type) { return type != kCommitOp && type != kAbortOp; }
+
+  // Holds an in-flight slot of its type from construction to destruction if
+  // admitted, and records the service time when released.
+  class Ticket
+  {
+  public:
+    Ticket(AdmissionController* controller, RpcType type, Clock::time_point deadline);
+    ~Ticket();
+
+    bool admitted() const { return status_.ok(); }
+    // OK if admitted, else the status to fail the RPC with
+    const grpc::Status& status() const { return status_; }
+    // how long a shed client should wait before retrying, 0 unless shed
+    uint64_t retry_after_ms() const { return retry_after_ms_; }
+
+  private:
+    AdmissionController* controller_;
+    RpcType type_;
+    grpc::Status status_;
+    uint64_t retry_after_ms_ = 0;
+    Clock::time_point start_;
+  };
+
+  size_t max_in_flight() const { return max_in_flight_; }
+  uint64_t in_flight(RpcType type) const { return types_[type].in_flight; }
+  uint64_t shed(RpcType type) const { return types_[type].shed; }
+  uint64_t expired(RpcType type) const { return types_[type].expired; }
+  uint64_t service_time_us(RpcType type) const { return types_[type].service_us; }
+
+  // totals over all RPC types
+  uint64_t shed() const;
+  uint64_t expired() const;
+
+private:
+  struct PerType {
+    std::atomic<uint64_t> in_flight{0};
+    std::atomic<uint64_t> shed{0};
+    std::atomic<uint64_t> expired{0};
+    std::atomic<uint64_t> service_us{0};   // EWMA, alpha 1/8
+  };
+
+  void RecordServiceTime(RpcType type, uint64_t us);
+
+  size_t max_in_flight_;
+  PerType types_[kNumRpcTypes];
+};
@@ -0,0 +1,80 @@
+#include "blob_cache.h"
+
+// rough per-entry bookkeeping cost (list node + index slot), so a cache full
+// of tiny blobs still respects the budget
+static constexpr size_t kEntryOverhead = 64;
+
+BlobCache::BlobCache(size_t capacity_bytes)
+  : capacity_bytes_(capacity_bytes),
+    shards_(kNumShards),
+    hits_(0),
+    misses_(0) {
+  for (auto& shard : shards_) {
+    shard.capacity = capacity_bytes / kNumShards;
+  }
+}
+
+bool BlobCache::Lookup(size_t key, std::string* value) {
+  Shard& shard = ShardFor(key);
+  std::lock_guard<std::mutex> guard(shard.mu);
+  auto it = shard.index.find(key);
+  if (it == shard.index.end()) {
+    misses_++;
+    return false;
+  }
+  shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+  *value = it->second->value;
+  hits_++;
+  return true;
+}
+
+void BlobCache::Insert(size_t key, const std::string& value) {
+  Shard& shard = ShardFor(key);
+  size_t charge = value.size() + kEntryOverhead;
+  std::lock_guard<std::mutex> guard(shard.mu);
+
+  auto it = shard.index.find(key);
+  if (it != shard.index.end()) {
+    EraseLocked(shard, it->second);
+  }
+  if (charge > shard.capacity) {
+    return;
+  }
+
+  while (shard.usage + charge > shard.capacity) {
+    EraseLocked(shard, std::prev(shard.lru.end()));
+  }
+  shard.lru.push_front(Entry{key, value});
+  shard.index[key] = shard.lru.begin();
+  shard.usage += charge;
+}
+
+void BlobCache::Erase(size_t key) {
+  Shard& shard = ShardFor(key);
+  std::lock_guard<std::mutex> guard(shard.mu);
+  auto it = shard.index.find(key);
+  if (it != shard.index.end()) {
+    EraseLocked(shard, it->second);
+  }
+}
+
+void BlobCache::EraseLocked(Shard& shard, std::list<Entry>::iterator it) {
+  shard.usage -= it->value.size() + kEntryOverhead;
+  shard.index.erase(it->key);
+  shard.lru.erase(it);
+}
+
+size_t BlobCache::usage_bytes() const {
+  size_t total = 0;
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> guard(shard.mu);
+    total += shard.usage;
+  }
+  return total;
+}
+
+double BlobCache::HitRate() const {
+  uint64_t h = hits_;
+  uint64_t m = misses_;
+  return (h + m) == 0 ? 0.0 : (double)h / (double)(h + m);
+}
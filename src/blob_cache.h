@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// In-memory cache of blob hash -> blob value that sits in front of the store.
+// Blobs are content addressed and therefore immutable, so the only thing the
+// cache has to do is decide what to keep within its byte budget. Keys are
+// spread over independently locked shards so handler threads working on
+// different blobs never contend, and each shard evicts in LRU order.
+class BlobCache
+{
+public:
+  static constexpr size_t kDefaultCapacityBytes = 64 << 20;
+  static constexpr size_t kNumShards = 16;
+
+  explicit BlobCache(size_t capacity_bytes = kDefaultCapacityBytes);
+
+  // Copies the cached value for key into *value. Returns false on a miss.
+  bool Lookup(size_t key, std::string* value);
+
+  // Inserts or replaces the value for key. Values larger than a shard's
+  // budget are not cached at all.
+  void Insert(size_t key, const std::string& value);
+
+  void Erase(size_t key);
+
+  size_t capacity_bytes() const { return capacity_bytes_; }
+  size_t usage_bytes() const;
+  uint64_t hits() const { return hits_; }
+  uint64_t misses() const { return misses_; }
+  double HitRate() const;
+
+private:
+  struct Entry {
+    size_t key;
+    std::string value;
+  };
+
+  struct Shard {
+    mutable std::mutex mu;
+    std::list<Entry> lru;  // front is most recently used
+    std::unordered_map<size_t, std::list<Entry>::iterator> index;
+    size_t usage = 0;
+    size_t capacity = 0;
+  };
+
+  Shard& ShardFor(size_t key) { return shards_[(key ^ (key >> 32)) % kNumShards]; }
+  static void EraseLocked(Shard& shard, std::list<Entry>::iterator it);
+
+  size_t capacity_bytes_;
+  std::vector<Shard> shards_;
+  std::atomic<uint64_t> hits_;
+  std::atomic<uint64_t> misses_;
+};
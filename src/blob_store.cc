@@ -0,0 +1,79 @@
+#include "blob_store.h"
+#include "log.h"
+
+#include <iostream>
+#include <mutex>
+
+std::string BlobStore::DefaultPath(const std::string& engine) {
+  if (engine == "log") {
+    return "/tmp/kv_store_log";
+  }
+  return "/tmp/kv_store";
+}
+
+std::unique_ptr<BlobStore> BlobStore::Open(const std::string& engine, const std::string& path) {
+  std::string dbPath = path.empty() ? DefaultPath(engine) : path;
+
+  if (engine == "memory") {
+    return std::make_unique<MemBlobStore>();
+  }
+  if (engine == "log") {
+    std::unique_ptr<BlobStore> store = LogBlobStore::Open(dbPath);
+    if (!store) {
+      std::cout << "Error opening blob log with path " << dbPath << std::endl;
+    }
+    return store;
+  }
+  if (engine == "leveldb") {
+    leveldb::Options options;
+    options.create_if_missing = true;
+    leveldb::DB* db;
+    leveldb::Status status = leveldb::DB::Open(options, dbPath, &db);
+    if (!status.ok()) {
+      std::cout << "Error opening leveldb with path " << dbPath << ": "
+                << status.ToString() << std::endl;
+      return nullptr;
+    }
+    return std::make_unique<LevelDBBlobStore>(db);
+  }
+
+  std::cout << "Unknown storage engine " << engine << std::endl;
+  return nullptr;
+}
+
+bool LevelDBBlobStore::Get(size_t key, std::string* value) {
+  leveldb::Status status = db_->Get(leveldb::ReadOptions(), std::to_string(key), value);
+  if (!status.ok() && !status.IsNotFound()) {
+    FC_LOG(kError) << "LevelDB error: " << status.ToString();
+  }
+  return status.ok();
+}
+
+bool LevelDBBlobStore::Put(size_t key, const std::string& value) {
+  leveldb::Status status = db_->Put(leveldb::WriteOptions(), std::to_string(key), value);
+  if (!status.ok()) {
+    FC_LOG(kError) << "LevelDB error: " << status.ToString();
+  }
+  return status.ok();
+}
+
+bool MemBlobStore::Get(size_t key, std::string* value) {
+  std::shared_lock<std::shared_mutex> guard(mu_);
+  auto it = blobs_.find(key);
+  if (it == blobs_.end()) {
+    return false;
+  }
+  *value = it->second;
+  return true;
+}
+
+bool MemBlobStore::Put(size_t key, const std::string& value) {
+  std::unique_lock<std::shared_mutex> guard(mu_);
+  blobs_[key] = value;
+  return true;
+}
+
+bool MemBlobStore::Contains(size_t key) {
+  std::shared_lock<std::shared_mutex> guard(mu_);
+  return blobs_.count(key) > 0;
+}
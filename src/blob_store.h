@@ -0,0 +1,109 @@
+#pragma once
+
+#include <leveldb/db.h>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Storage engine behind the server handlers. Blobs are addressed by the hash
+// of their content, so engines only need point reads and writes; there are no
+// scans, deletes or ordering requirements.
+class BlobStore
+{
+public:
+  virtual ~BlobStore() = default;
+
+  // Copies the blob stored under key into *value. Returns false if the key is
+  // missing or the engine failed to read it.
+  virtual bool Get(size_t key, std::string* value) = 0;
+
+  // Stores value under key, replacing any previous value.
+  virtual bool Put(size_t key, const std::string& value) = 0;
+
+  virtual bool Contains(size_t key) {
+    std::string value;
+    return Get(key, &value);
+  }
+
+  virtual std::string name() const = 0;
+
+  // engine is one of "leveldb", "memory" or "log". An empty path picks the
+  // engine's default location. Returns nullptr if the engine can't be opened.
+  static std::unique_ptr<BlobStore> Open(const std::string& engine, const std::string& path);
+  static std::string DefaultPath(const std::string& engine);
+};
+
+// The original engine: one LevelDB key per blob, keyed by the decimal hash.
+class LevelDBBlobStore final : public BlobStore
+{
+public:
+  explicit LevelDBBlobStore(leveldb::DB* db) : db_(db) {}
+  ~LevelDBBlobStore() override { delete db_; }
+
+  bool Get(size_t key, std::string* value) override;
+  bool Put(size_t key, const std::string& value) override;
+  std::string name() const override { return "leveldb"; }
+
+private:
+  leveldb::DB* db_;
+};
+
+// Volatile hash map, for tests and benchmarks.
+class MemBlobStore final : public BlobStore
+{
+public:
+  bool Get(size_t key, std::string* value) override;
+  bool Put(size_t key, const std::string& value) override;
+  bool Contains(size_t key) override;
+  std::string name() const override { return "memory"; }
+
+private:
+  std::shared_mutex mu_;
+  std::unordered_map<size_t, std::string> blobs_;
+};
+
+// Append-only segment log with an in-memory hash index. Every Put appends a
+// record to the active segment file; segments are mmap'ed so a Get is an
+// index lookup plus a memcpy. Since blobs never change there is nothing to
+// compact, and an identical re-Put is dropped without touching the disk.
+// The index is rebuilt by scanning the segments on open.
+class LogBlobStore final : public BlobStore
+{
+public:
+  static constexpr size_t kSegmentBytes = 64 << 20;
+
+  static std::unique_ptr<LogBlobStore> Open(const std::string& dir, bool sync = false);
+  ~LogBlobStore() override;
+
+  bool Get(size_t key, std::string* value) override;
+  bool Put(size_t key, const std::string& value) override;
+  bool Contains(size_t key) override;
+  std::string name() const override { return "log"; }
+
+private:
+  struct Segment {
+    int fd = -1;
+    uint64_t size = 0;      // bytes written so far
+    char* map = nullptr;    // mapped for map_len bytes, which may exceed size
+    size_t map_len = 0;
+  };
+  struct Location {
+    uint32_t segment;
+    uint64_t offset;        // start of the value, past the record header
+    uint64_t len;
+  };
+
+  LogBlobStore(const std::string& dir, bool sync) : dir_(dir), sync_(sync) {}
+  bool Recover();
+  bool RecoverSegment(Segment* seg, uint32_t id);
+  bool AddSegment(size_t min_bytes);
+  std::string SegmentPath(uint32_t id) const;
+
+  std::string dir_;
+  bool sync_;
+  std::shared_mutex mu_;
+  std::vector<Segment> segments_;           // last one is the active segment
+  std::unordered_map<size_t, Location> index_;
+};
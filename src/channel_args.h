@@ -0,0 +1,18 @@
+#pragma once
+
+#include <grpcpp/grpcpp.h>
+
+#include <climits>
+
+// Largest message either side accepts: values and key tables are sent whole.
+constexpr int kFCKVMaxMessageSize = INT_MAX;
+
+// Channel arguments matching the server's message size limits, shared by
+// createChannel and in-process channels to an embedded server.
+inline grpc::ChannelArguments fcKVChannelArguments()
+{
+  grpc::ChannelArguments args;
+  args.SetMaxSendMessageSize(kFCKVMaxMessageSize);
+  args.SetMaxReceiveMessageSize(kFCKVMaxMessageSize);
+  return args;
+}
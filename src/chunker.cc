@@ -0,0 +1,62 @@
+#include "chunker.h"
+
+#include <algorithm>
+#include <array>
+
+// masks over the top bits of the gear hash, which depend on the most recent
+// 64 bytes; 17 bits before the average size, 13 after (FastCDC level 2)
+static constexpr uint64_t kMaskSmall = ~0ULL << (64 - 17);
+static constexpr uint64_t kMaskLarge = ~0ULL << (64 - 13);
+
+// the gear table only has to be random looking and fixed forever, chunk
+// boundaries (and therefore dedup across clients) depend on it
+static std::array<uint64_t, 256> MakeGearTable() {
+  std::array<uint64_t, 256> table;
+  uint64_t x = 0x6663206b76207374ULL;
+  for (auto& entry : table) {
+    // splitmix64
+    uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    entry = z ^ (z >> 31);
+  }
+  return table;
+}
+
+static const std::array<uint64_t, 256> kGear = MakeGearTable();
+
+size_t Chunker::NextBoundary(const unsigned char* data, size_t len) {
+  if (len <= kMinChunkSize) {
+    return len;
+  }
+  size_t end = std::min(len, kMaxChunkSize);
+  size_t normal = std::min(end, kAvgChunkSize);
+
+  uint64_t fp = 0;
+  size_t i = kMinChunkSize;
+  for (; i < normal; i++) {
+    fp = (fp << 1) + kGear[data[i]];
+    if (!(fp & kMaskSmall)) {
+      return i + 1;
+    }
+  }
+  for (; i < end; i++) {
+    fp = (fp << 1) + kGear[data[i]];
+    if (!(fp & kMaskLarge)) {
+      return i + 1;
+    }
+  }
+  return end;
+}
+
+std::vector<std::string_view> Chunker::Split(std::string_view data) {
+  std::vector<std::string_view> chunks;
+  const unsigned char* p = (const unsigned char*)data.data();
+  size_t offset = 0;
+  while (offset < data.size()) {
+    size_t len = NextBoundary(p + offset, data.size() - offset);
+    chunks.push_back(data.substr(offset, len));
+    offset += len;
+  }
+  return chunks;
+}
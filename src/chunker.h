@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Content-defined chunking (FastCDC) for large values.
+//
+// Chunk boundaries are picked by a rolling gear hash over the content rather
+// than at fixed offsets, so an edit only changes the chunks around it and
+// the rest of the value still splits into the same, already stored, chunks.
+// Normalized chunking keeps sizes close to kAvgChunkSize: below the average
+// a boundary needs more hash bits to be zero than above it.
+class Chunker
+{
+public:
+  static constexpr size_t kMinChunkSize = 8 << 10;
+  static constexpr size_t kAvgChunkSize = 32 << 10;
+  static constexpr size_t kMaxChunkSize = 256 << 10;
+
+  // values at least this big are stored chunked
+  static constexpr size_t kChunkThreshold = 64 << 10;
+
+  // Splits data into consecutive chunks that cover it exactly. The views
+  // point into data.
+  static std::vector<std::string_view> Split(std::string_view data);
+
+private:
+  static size_t NextBoundary(const unsigned char* data, size_t len);
+};
@@ -2,18 +2,33 @@
 
 #include <filesystem>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 #include <iostream>
 #include <exception>
+#include <fstream>
+#include <future>
+#include <random>
+#include <thread>
 #include <openssl/rsa.h>
 #include <openssl/pem.h>
+#include <openssl/sha.h>
 
+#include "admission.h"
+#include "channel_args.h"
+#include "chunker.h"
 #include "customer.h"
+#include "log.h"
+#include "trace.h"
 
 using fc_kv_store::GetRequest;
 using fc_kv_store::GetResponse;
 using fc_kv_store::PutRequest;
 using fc_kv_store::PutResponse;
+using fc_kv_store::HasBlobsRequest;
+using fc_kv_store::HasBlobsResponse;
+using fc_kv_store::ChunkManifest;
 using fc_kv_store::StartOpRequest;
 using fc_kv_store::StartOpResponse;
 using fc_kv_store::CommitOpRequest;
@@ -26,10 +41,17 @@ using fc_kv_store::TamperInfoRequest;
 using fc_kv_store::TamperInfoResponse;
 
 
+// bounds FCKVClient::verified_
+static const size_t kMaxVerifiedStructs = 4096;
+
+// longest wait between attempts of an RPC the server shed, before jitter
+static const uint64_t kMaxBackoffMs = 1000;
+
 // std::string privateKeyFile = "private_key.pem";
 // std::string publicKeyFile = "public_key.pem";
 
 bool signVersionStruct(VersionStruct* versionStruct, std::string privateKeyFile) {
+    FC_TRACE_SPAN("signVersionStruct");
     // Serialize the VersionStruct without the signature field
     versionStruct->clear_signature();
     std::string serializedData = versionStruct->SerializeAsString();
@@ -37,14 +59,14 @@ bool signVersionStruct(VersionStruct* versionStruct, std::string privateKeyFile)
     // Load the private key from the file
     FILE* privateKeyFilePtr = fopen(privateKeyFile.c_str(), "rb");
     if (!privateKeyFilePtr) {
-        std::cerr << "Failed to open private key file." << std::endl;
+        FC_LOG(kError) << "Failed to open private key file.";
         return false;
     }
 
     RSA* privateKey = PEM_read_RSAPrivateKey(privateKeyFilePtr, nullptr, nullptr, nullptr);
     fclose(privateKeyFilePtr);
     if (!privateKey) {
-        std::cerr << "Failed to read private key from file." << std::endl;
+        FC_LOG(kError) << "Failed to read private key from file.";
         return false;
     }
 
@@ -62,7 +84,7 @@ bool signVersionStruct(VersionStruct* versionStruct, std::string privateKeyFile)
     RSA_free(privateKey);
 
     if (result != 1) {
-        std::cerr << "Failed to sign the VersionStruct content." << std::endl;
+        FC_LOG(kError) << "Failed to sign the VersionStruct content.";
         return false;
     }
 
@@ -72,17 +94,121 @@ bool signVersionStruct(VersionStruct* versionStruct, std::string privateKeyFile)
     return true;
 }
 
+bool verifyVersionStruct(const VersionStruct& versionStruct) {
+    FC_TRACE_SPAN("verifyVersionStruct");
+    // Serialize the VersionStruct without the signature field, as it was signed
+    VersionStruct unsigned_struct(versionStruct);
+    unsigned_struct.clear_signature();
+    std::string serializedData = unsigned_struct.SerializeAsString();
+
+    const std::string& pem = versionStruct.pubkey();
+    BIO* bio = BIO_new_mem_buf(pem.data(), pem.size());
+    if (!bio) {
+        return false;
+    }
+    RSA* publicKey = PEM_read_bio_RSAPublicKey(bio, nullptr, nullptr, nullptr);
+    BIO_free(bio);
+    if (!publicKey) {
+        FC_LOG(kError) << "Failed to read public key from VersionStruct.";
+        return false;
+    }
+
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256((const unsigned char*)serializedData.data(), serializedData.size(), hash);
+
+    const std::string& signature = versionStruct.signature();
+    int result = RSA_verify(NID_sha256, hash, SHA256_DIGEST_LENGTH,
+                            (const unsigned char*)signature.data(), signature.size(), publicKey);
+    RSA_free(publicKey);
+    return result == 1;
+}
+
+std::string defaultEndpoint() {
+  const char* endpoint = std::getenv("FC_KV_STORE_ENDPOINT");
+  return (endpoint && *endpoint) ? endpoint : "localhost:50051";
+}
+
+std::shared_ptr<Channel> createChannel(const std::string& endpoint) {
+  return grpc::CreateCustomChannel(endpoint, grpc::InsecureChannelCredentials(), fcKVChannelArguments());
+}
+
+static std::string ReadFile(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+FCKVClient::FCKVClient(std::shared_ptr<Channel> channel, std::string pubkey, const std::string& privateKeyFile, const std::string& publicKeyFile,
+                       const FCKVClientOptions& options)
+  : stub_(FCKVStoreRPC::NewStub(channel)),
+    pubkey_(pubkey),
+    privateKeyFile_(privateKeyFile),
+    publicKeyFile_(publicKeyFile),
+    namespace_(options.namespace_id),
+    rpc_timeout_ms_(options.rpc_timeout_ms),
+    max_attempts_(std::max(options.max_attempts, 1)),
+    verify_threads_(std::max<size_t>(options.verify_threads, 1)) {
+  bool haveKeys = std::filesystem::exists(privateKeyFile) && std::filesystem::exists(publicKeyFile);
+
+  if (!options.state_dir.empty()) {
+    local_state_ = LocalState::Open(options.state_dir);
+    if (!local_state_) {
+      throw std::runtime_error("Failed to open client state directory.");
+    }
+    // a saved version struct is only usable with the keys that signed it
+    if (haveKeys) {
+      bool saved = local_state_->Load(&version_, &itable_);
+      hasPending_ = local_state_->LoadPending(&pending_, &pendingItable_);
+      if (saved || hasPending_) {
+        publicKeyPem_ = ReadFile(publicKeyFile);
+        version_.set_pubkey(publicKeyPem_);
+        return;
+      }
+    }
+    version_.Clear();
+    itable_.Clear();
+  }
+
+  if (std::filesystem::exists(privateKeyFile) || std::filesystem::exists(publicKeyFile)) {
+      // std::cout << "Log: Private or public key file already exists. Overwriting the files." << std::endl;
+  }
+
+  if (generateRSAKeyPair(privateKeyFile, publicKeyFile)) {
+      // std::cout << "Log: RSA key pair generated successfully." << std::endl;
+  } else {
+      throw std::runtime_error("Failed to generate RSA key pair.");
+  }
+  // other users verify our signatures with this
+  publicKeyPem_ = ReadFile(publicKeyFile);
+  version_.set_pubkey(publicKeyPem_);
+}
+
 Status FCKVClient::PreOpValidate(VersionStruct* inprogress, size_t* tblhash) {
+  FC_TRACE_SPAN("PreOpValidate");
   std::vector<VersionStruct> all_versions;
-  StartOp(&all_versions);
+  Status started = StartOp(&all_versions);
+  if (!started.ok()) {
+    FC_LOG(kWarn) << "StartOp failed: " << started.error_code() << ": " << started.error_message();
+    // a reply lost to the deadline may still have taken the lock for us
+    if (started.error_code() == grpc::StatusCode::DEADLINE_EXCEEDED) {
+      AbortOp();
+    }
+    return started;
+  }
 
   if (all_versions.size() == 0) {
-    std::cout << "all versions was 0 sized" << std::endl;
+    FC_LOG(kDebug) << "all versions was 0 sized";
     inprogress->CopyFrom(version_);
     *tblhash = 0;
     return Status::OK;
   }
 
+  Status verified = VerifyVersions(all_versions);
+  if (!verified.ok()) {
+    FC_LOG(kWarn) << "Bad signature on a version struct, aborting operation";
+    AbortOp();
+    return verified;
+  }
+
   // find our version and the max version num
   int maxversionloc = 0;
   for (int i = 1; i < all_versions.size(); i++) {
@@ -93,10 +219,22 @@ Status FCKVClient::PreOpValidate(VersionStruct* inprogress, size_t* tblhash) {
   
   int loc = -1;
   for (int i = 0; i < all_versions.size(); i++) {
-    if (all_versions[i].pubkey() == pubkey_) {
-      // just abort if the signatures don't match, there is a problem here
-      if (all_versions[i].signature() != version_.signature()) {
-        std::cout << "Bad version!" << std::endl;
+    if (all_versions[i].pubkey() == publicKeyPem_) {
+      // our struct is not signature checked, so it must be the exact one we
+      // committed: a matching signature alone would let the server edit the
+      // other fields
+      std::string ours = all_versions[i].SerializeAsString();
+      // a commit we signed may have landed without us seeing the reply
+      if (ours != version_.SerializeAsString() && hasPending_ &&
+          ours == pending_.SerializeAsString()) {
+        version_ = pending_;
+        itable_ = pendingItable_;
+        SaveLocalState();
+      }
+      // just abort if the structs don't match, there is a problem here
+      if (ours != version_.SerializeAsString()) {
+        FC_LOG(kWarn) << "Bad version!";
+        AbortOp();
         return Status(grpc::StatusCode::UNKNOWN, "signature mismatch");
       }
       loc = i;
@@ -120,65 +258,122 @@ Status FCKVClient::PreOpValidate(VersionStruct* inprogress, size_t* tblhash) {
   // from now on, our version is the last one in the all_versions list
   // because it is sorted by version() in CheckCompatability
   if (!CheckCompatability(all_versions)) {
-    std::cout << "History incompatability, aborting operation" << std::endl;
+    FC_LOG(kWarn) << "History incompatability, aborting operation";
     AbortOp();
     return Status(grpc::StatusCode::UNKNOWN, "history incompatability");
   }
   *inprogress = all_versions[all_versions.size() - 1];
 
   // update version vector
+  inprogress->clear_vlist();
   for (auto v : all_versions) {
     UserVersion* uv = inprogress->add_vlist();
     uv->set_user(hasher_(v.pubkey()));
     uv->set_version(v.version());
   }
-  
-  // sign new version struct
-  if (!signVersionStruct(inprogress, privateKeyFile_)) {
-    std::cerr << "Failed to sign the VersionStruct content." << std::endl;
-    return Status(grpc::StatusCode::UNKNOWN, "failed to sign versionstruct");
-  }
 
+  // the struct is signed in CommitOp, once the itable hash is final
   return Status::OK;
 }
 
+Status FCKVClient::VerifyVersions(const std::vector<VersionStruct>& versions) {
+  FC_TRACE_SPAN("VerifyVersions");
+  std::vector<const VersionStruct*> todo;
+  std::vector<std::string> keys;
+  for (auto& v : versions) {
+    // ours is checked against version_ by PreOpValidate
+    if (v.pubkey() == publicKeyPem_) {
+      continue;
+    }
+    // the server is untrusted, so a struct may only skip verification if it
+    // is byte for byte one we checked: key on a collision resistant digest
+    std::string serialized = v.SerializeAsString();
+    std::string key(SHA256_DIGEST_LENGTH, '\0');
+    SHA256((const unsigned char*)serialized.data(), serialized.size(), (unsigned char*)key.data());
+    if (verified_.count(key) == 0) {
+      todo.push_back(&v);
+      keys.push_back(key);
+    }
+  }
+  if (todo.empty()) {
+    return Status::OK;
+  }
+
+  verifications_ += todo.size();
+  std::vector<bool> ok(todo.size());
+  if (todo.size() == 1) {
+    ok[0] = verifyVersionStruct(*todo[0]);
+  } else {
+    // most clients never see more than one other struct, so only start the
+    // pool once there is a batch to spread over it
+    if (!verify_pool_) {
+      verify_pool_ = std::make_unique<ThreadPool>(verify_threads_);
+    }
+    std::vector<std::future<bool>> results;
+    for (auto* v : todo) {
+      results.push_back(verify_pool_->Submit([v] { return verifyVersionStruct(*v); }));
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+      ok[i] = results[i].get();
+    }
+  }
+
+  // every user has one live struct, so the cache only outgrows the user
+  // count through churn; start over rather than track what is stale
+  if (verified_.size() + todo.size() > kMaxVerifiedStructs) {
+    verified_.clear();
+  }
+  bool allok = true;
+  for (size_t i = 0; i < todo.size(); i++) {
+    if (ok[i]) {
+      verified_.insert(keys[i]);
+    } else {
+      allok = false;
+    }
+  }
+  return allok ? Status::OK : Status(grpc::StatusCode::UNKNOWN, "bad version struct signature");
+}
+
 std::pair<int, std::string> FCKVClient::Get(std::string key) {
+  FC_TRACE_BEGIN_OP();
+  FC_TRACE_SPAN("Get");
   VersionStruct inprogress;
   size_t tblhash;
   if (!PreOpValidate(&inprogress, &tblhash).ok()) {
-    std::cerr << "Pre-operation validation failed" << std::endl;
+    FC_LOG(kWarn) << "Pre-operation validation failed";
     return std::make_pair(-1, "Error occurred");
   }
 
+  // from here on we hold the namespace lock, every failure must release it
   grpc::Status update_status = UpdateItable(tblhash);
   if (!update_status.ok()) {
-    std::cout << "Problem updating keytable in get - UpdateItable error: " << update_status.error_code() << ": " << update_status.error_message() << std::endl;
+    FC_LOG(kWarn) << "Problem updating keytable in get - UpdateItable error: " << update_status.error_code() << ": " << update_status.error_message();
+    AbortOp();
     return std::make_pair(-1, "Error occurred");
   }
   inprogress.set_itablehash(tblhash);
     
   // Do GetRequest with H(value) from key table
-  GetRequest req;
-  size_t hashvalue = (*itable_.mutable_table())[hasher_(key)];
-  req.set_pubkey(hasher_(pubkey_));
-  req.set_key(hashvalue);
-  
-  GetResponse reply;
-  ClientContext context;
-  Status status = stub_->FCKVStoreGet(&context, req, &reply);
+  std::string value;
+  Status status;
+  auto chunked = itable_.chunked().find(hasher_(key));
+  if (chunked != itable_.chunked().end()) {
+    status = FetchChunked(chunked->second, &value);
+  } else {
+    size_t hashvalue = (*itable_.mutable_table())[hasher_(key)];
+    status = FetchBlob(hashvalue, &value);
+  }
   
-  if (status.ok() && CommitOp(inprogress).ok()) {
+  if (status.ok() && CommitOp(&inprogress).ok()) {
     // TODO does this copy actually work?
-    std::cout << "Log: Successfully completed get"
-              << std::endl;
+    FC_LOG(kDebug) << "Successfully completed get";
     version_.CopyFrom(inprogress);
-    return std::make_pair(0, reply.value());
+    SaveLocalState();
+    return std::make_pair(0, value);
   }
   
-  std::cout << "Log: Failed to complete get"
-              << std::endl;
-  std::cout << status.error_code() << ": " << status.error_message()
-            << std::endl;
+  FC_LOG(kWarn) << "Failed to complete get: " << status.error_code() << ": " << status.error_message();
+  AbortOp();
   return std::make_pair(-1, "Error occurred");
 }
 
@@ -205,84 +400,127 @@ int FCKVClient::TamperInfo(std::string key, std::string value, int type)
 }
 
 int FCKVClient::Put(std::string key, std::string value) {
+  FC_TRACE_BEGIN_OP();
+  FC_TRACE_SPAN("Put");
   VersionStruct inprogress;
   size_t tblhash;
   if (!PreOpValidate(&inprogress, &tblhash).ok()) {
-    std::cerr << "Pre-operation validation failed" << std::endl;
+    FC_LOG(kWarn) << "Pre-operation validation failed";
     return -1;
   }
+  // from here on we hold the namespace lock, every failure must release it
   grpc::Status update_status = UpdateItable(tblhash);
   if (!update_status.ok()) {
-    std::cout << "Problem updating keytable in put - UpdateItable error: " << update_status.error_code() << ": " << update_status.error_message() << std::endl;
+    FC_LOG(kWarn) << "Problem updating keytable in put - UpdateItable error: " << update_status.error_code() << ": " << update_status.error_message();
+    AbortOp();
     return -1;
   }
   inprogress.set_itablehash(tblhash);
     
-  // Do PutRequest
-  PutRequest req;
-  PutResponse reply;
-  ClientContext context;
-  req.set_pubkey(hasher_(pubkey_));
-  req.set_value(value);
-  Status status = stub_->FCKVStorePut(&context, req, &reply);
-  
-  if (!status.ok()) {
-    std::cout << "Error on line 196: " << status.error_code() << ": " << status.error_message() << std::endl;
-  }
+  Status status;
+  size_t hashvalue;
+  size_t serverhash;
+  bool chunked = value.size() >= Chunker::kChunkThreshold;
+  if (chunked) {
+    status = PutChunked(value, &hashvalue);
+    if (!status.ok()) {
+      FC_LOG(kWarn) << "Chunked put failed: " << status.error_code() << ": " << status.error_message();
+      AbortOp();
+      return -1;
+    }
+  } else {
+    // Do PutRequest
+    PutRequest req;
+    PutResponse reply;
+    req.set_pubkey(hasher_(pubkey_));
+    req.set_namespace_id(namespace_);
+    req.set_value(value);
+    {
+      FC_TRACE_SPAN("PutValueRpc");
+      status = CallWithBackoff([&](ClientContext* context) {
+        return stub_->FCKVStorePut(context, req, &reply);
+      });
+    }
 
-  size_t hashvalue = hasher_(value);
-  size_t serverhash = reply.hash();
+    if (!status.ok()) {
+      FC_LOG(kWarn) << "Put value failed: " << status.error_code() << ": " << status.error_message();
+    }
 
-  if (hashvalue != serverhash) {
-    std::cout << "Server hashed our value differently than we did. Error!"
-              << std::endl;
-    return -1;
+    hashvalue = hasher_(value);
+    serverhash = reply.hash();
+
+    if (hashvalue != serverhash) {
+      FC_LOG(kError) << "Server hashed our value differently than we did. Error!";
+      AbortOp();
+      return -1;
+    }
   }
 
-  // update key table
-  (*itable_.mutable_table())[hasher_(key)] = hashvalue;
+  // update key table, a key lives in exactly one of the two maps
+  if (chunked) {
+    (*itable_.mutable_chunked())[hasher_(key)] = hashvalue;
+    itable_.mutable_table()->erase(hasher_(key));
+  } else {
+    (*itable_.mutable_table())[hasher_(key)] = hashvalue;
+    itable_.mutable_chunked()->erase(hasher_(key));
+  }
   std::string serializeditable;
-  itable_.SerializeToString(&serializeditable);
+  {
+    FC_TRACE_SPAN("SerializeItable");
+    itable_.SerializeToString(&serializeditable);
+  }
   
   PutRequest tblreq;
   PutResponse tblreply;
-  ClientContext tblcontext;
   tblreq.set_pubkey(hasher_(pubkey_));
+  tblreq.set_namespace_id(namespace_);
   tblreq.set_value(serializeditable);
-  status = stub_->FCKVStorePut(&tblcontext, tblreq, &tblreply);
+  {
+    FC_TRACE_SPAN("PutItableRpc");
+    status = CallWithBackoff([&](ClientContext* context) {
+      return stub_->FCKVStorePut(context, tblreq, &tblreply);
+    });
+  }
 
   if (!status.ok()) {
-    std::cout << "Error on line 221: " << status.error_code() << ": " << status.error_message() << std::endl;
+    FC_LOG(kWarn) << "Put itable failed: " << status.error_code() << ": " << status.error_message();
   }
 
   hashvalue = hasher_(serializeditable);
   serverhash = tblreply.hash();
 
   if (hashvalue != serverhash) {
-    std::cout << "Server hashed our itable differently than we did. Error!"
-              << std::endl;
+    FC_LOG(kError) << "Server hashed our itable differently than we did. Error!";
+    AbortOp();
     return -1;
   }
 
   inprogress.set_itablehash(hashvalue);
+
+  if (local_state_) {
+    // chunks and the manifest were cached by StoreBlob
+    if (!chunked) {
+      local_state_->PutBlob(hasher_(value), value);
+    }
+    local_state_->PutBlob(hashvalue, serializeditable);
+  }
   
-  if (status.ok() && CommitOp(inprogress).ok()) {
+  if (status.ok() && CommitOp(&inprogress).ok()) {
     // TODO does this copy actually work?
     version_ = inprogress;
-    std::cout << "Log: Successfully completed put"
-              << std::endl;
+    SaveLocalState();
+    FC_LOG(kDebug) << "Successfully completed put";
     return 0;
   }
   
-  std::cout << "Log: Failed to complete put"
-              << std::endl;
-  std::cout << status.error_code() << ": " << status.error_message()
-            << std::endl;
+  FC_LOG(kWarn) << "Failed to complete put: " << status.error_code() << ": " << status.error_message();
+  AbortOp();
   return -1;
 }
 
 // fetch key table from most recent version if it is different than ours
 Status FCKVClient::UpdateItable(size_t latest_itablehash) {
+  FC_TRACE_SPAN("UpdateItable");
   Status status = Status::OK;
   if (latest_itablehash == 0) {
     return status;
@@ -292,30 +530,196 @@ Status FCKVClient::UpdateItable(size_t latest_itablehash) {
   itable_.SerializeToString(&local_itable);
 
   if (latest_itablehash != hasher_(local_itable)) {
-    GetRequest req;
-    GetResponse reply;
-    ClientContext context;
-
-    req.set_pubkey(hasher_(pubkey_));
-    req.set_key(latest_itablehash);
-    status = stub_->FCKVStoreGet(&context, req, &reply);
-    // TODO validate (check hashes match)
+    std::string value;
+    status = FetchBlob(latest_itablehash, &value);
     if (status.ok()) {
-      itable_.ParseFromString(reply.value());
+      FC_TRACE_SPAN("ParseItable");
+      itable_.ParseFromString(value);
     }
   }
   return status;
 }
 
+Status FCKVClient::FetchBlob(size_t hash, std::string* value) {
+  FC_TRACE_SPAN("FetchBlob");
+  if (local_state_ && local_state_->GetBlob(hash, value)) {
+    return Status::OK;
+  }
+
+  GetRequest req;
+  GetResponse reply;
+  req.set_pubkey(hasher_(pubkey_));
+  req.set_namespace_id(namespace_);
+  req.set_key(hash);
+  Status status = CallWithBackoff([&](ClientContext* context) {
+    return stub_->FCKVStoreGet(context, req, &reply);
+  });
+  if (!status.ok()) {
+    return status;
+  }
+  *value = reply.value();
+  // blobs are content addressed, the server may hand back bad data
+  if (hasher_(*value) != hash) {
+    FC_LOG(kError) << "Blob " << hash << " does not match its hash";
+    return Status(grpc::StatusCode::DATA_LOSS, "blob hash mismatch");
+  }
+  if (local_state_) {
+    local_state_->PutBlob(hash, *value);
+  }
+  return status;
+}
+
+Status FCKVClient::StoreBlob(const std::string& blob, size_t* hash) {
+  PutRequest req;
+  PutResponse reply;
+  req.set_pubkey(hasher_(pubkey_));
+  req.set_namespace_id(namespace_);
+  req.set_value(blob);
+  Status status = CallWithBackoff([&](ClientContext* context) {
+    return stub_->FCKVStorePut(context, req, &reply);
+  });
+  if (!status.ok()) {
+    return status;
+  }
+  *hash = hasher_(blob);
+  if (reply.hash() != *hash) {
+    return Status(grpc::StatusCode::DATA_LOSS, "server hashed blob differently");
+  }
+  if (local_state_) {
+    local_state_->PutBlob(*hash, blob);
+  }
+  return Status::OK;
+}
+
+Status FCKVClient::PutChunked(const std::string& value, size_t* manifesthash) {
+  FC_TRACE_SPAN("PutChunked");
+  std::vector<std::string_view> chunks;
+  {
+    FC_TRACE_SPAN("ChunkValue");
+    chunks = Chunker::Split(value);
+  }
+
+  // std::hash of a string_view matches std::hash of the same std::string
+  std::hash<std::string_view> viewhasher;
+  ChunkManifest manifest;
+  manifest.set_size(value.size());
+  HasBlobsRequest hasreq;
+  hasreq.set_pubkey(hasher_(pubkey_));
+  hasreq.set_namespace_id(namespace_);
+  std::unordered_map<size_t, std::string_view> unique;
+  for (auto chunk : chunks) {
+    size_t hash = viewhasher(chunk);
+    manifest.add_chunks(hash);
+    if (unique.emplace(hash, chunk).second) {
+      hasreq.add_hashes(hash);
+    }
+  }
+
+  HasBlobsResponse hasreply;
+  Status status;
+  {
+    FC_TRACE_SPAN("HasBlobsRpc");
+    status = CallWithBackoff([&](ClientContext* context) {
+      return stub_->FCKVStoreHasBlobs(context, hasreq, &hasreply);
+    });
+  }
+  if (!status.ok()) {
+    return status;
+  }
+
+  for (uint64_t hash : hasreply.missing()) {
+    auto it = unique.find(hash);
+    if (it == unique.end()) {
+      continue;
+    }
+    FC_TRACE_SPAN("PutChunkRpc");
+    size_t stored;
+    status = StoreBlob(std::string(it->second), &stored);
+    if (!status.ok()) {
+      return status;
+    }
+  }
+
+  return StoreBlob(manifest.SerializeAsString(), manifesthash);
+}
+
+Status FCKVClient::FetchChunked(size_t manifesthash, std::string* value) {
+  FC_TRACE_SPAN("FetchChunked");
+  std::string serialized;
+  Status status = FetchBlob(manifesthash, &serialized);
+  if (!status.ok()) {
+    return status;
+  }
+  ChunkManifest manifest;
+  if (!manifest.ParseFromString(serialized)) {
+    return Status(grpc::StatusCode::DATA_LOSS, "bad chunk manifest");
+  }
+
+  value->clear();
+  value->reserve(manifest.size());
+  for (uint64_t hash : manifest.chunks()) {
+    std::string chunk;
+    status = FetchBlob(hash, &chunk);
+    if (!status.ok()) {
+      return status;
+    }
+    value->append(chunk);
+  }
+  if (value->size() != manifest.size()) {
+    return Status(grpc::StatusCode::DATA_LOSS, "chunked value has the wrong size");
+  }
+  return Status::OK;
+}
+
+void FCKVClient::SaveLocalState() {
+  hasPending_ = false;
+  if (local_state_) {
+    local_state_->Save(version_, itable_);
+  }
+}
+
+Status FCKVClient::CallWithBackoff(const std::function<Status(ClientContext*)>& rpc) {
+  thread_local std::mt19937_64 rng(std::random_device{}());
+  for (int attempt = 1; ; attempt++) {
+    ClientContext context;
+    FC_TRACE_INJECT(context);
+    if (rpc_timeout_ms_) {
+      context.set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(rpc_timeout_ms_));
+    }
+    Status status = rpc(&context);
+    if (status.error_code() != grpc::StatusCode::RESOURCE_EXHAUSTED || attempt >= max_attempts_) {
+      return status;
+    }
+    // only admission control sends a hint; other RESOURCE_EXHAUSTED errors
+    // (message too large, ...) will not go away by waiting
+    auto& trailers = context.GetServerTrailingMetadata();
+    auto hint = trailers.find(AdmissionController::kRetryAfterMetadataKey);
+    if (hint == trailers.end()) {
+      return status;
+    }
+    uint64_t delay = std::strtoull(std::string(hint->second.data(), hint->second.size()).c_str(), nullptr, 10);
+    delay = std::min<uint64_t>(std::max<uint64_t>(delay, 1) << (attempt - 1), kMaxBackoffMs);
+    // at least the server's hint, spread so shed clients don't return in lockstep
+    delay = std::uniform_int_distribution<uint64_t>(delay, 2 * delay)(rng);
+    FC_LOG(kDebug) << "Server overloaded, retrying in " << delay << "ms";
+    FC_TRACE_SPAN("Backoff");
+    std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+  }
+}
+
 // we should expect the server to return the complete list of version structs
 // TODO optimization - only return the diff between what we and the server know
 Status FCKVClient::StartOp(std::vector<VersionStruct>* versions) {
+  FC_TRACE_SPAN("StartOp");
   StartOpRequest req;
   StartOpResponse reply;
-  ClientContext context;
   req.set_pubkey(hasher_(pubkey_));
-  Status status = stub_->FCKVStoreStartOp(&context, req, &reply);
+  req.set_namespace_id(namespace_);
+  Status status = CallWithBackoff([&](ClientContext* context) {
+    return stub_->FCKVStoreStartOp(context, req, &reply);
+  });
   if (status.ok()) {
+    FC_TRACE_SPAN("ParseVersions");
     for (std::string v : reply.versions()) {
       VersionStruct version;
       version.ParseFromString(v);
@@ -325,29 +729,50 @@ Status FCKVClient::StartOp(std::vector<VersionStruct>* versions) {
   return status;
 }
 
-Status FCKVClient::CommitOp(VersionStruct version) {
+Status FCKVClient::CommitOp(VersionStruct* version) {
+  FC_TRACE_SPAN("CommitOp");
+  // sign new version struct
+  if (!signVersionStruct(version, privateKeyFile_)) {
+    FC_LOG(kError) << "Failed to sign the VersionStruct content.";
+    return Status(grpc::StatusCode::UNKNOWN, "failed to sign versionstruct");
+  }
+  // remember what we are about to commit, in case we never see the reply
+  pending_ = *version;
+  pendingItable_ = itable_;
+  hasPending_ = true;
+  // callers abort on failure
+  if (local_state_ && !local_state_->SavePending(pending_, pendingItable_)) {
+    return Status(grpc::StatusCode::UNKNOWN, "failed to save pending commit");
+  }
+
   CommitOpRequest req;
   CommitOpResponse reply;
-  ClientContext context;
 
   VersionStruct* msgversion = req.mutable_v();
-  msgversion->CopyFrom(version);
+  msgversion->CopyFrom(*version);
   req.set_pubkey(hasher_(pubkey_));
-  return stub_->FCKVStoreCommitOp(&context, req, &reply);
+  req.set_namespace_id(namespace_);
+  return CallWithBackoff([&](ClientContext* context) {
+    return stub_->FCKVStoreCommitOp(context, req, &reply);
+  });
 }
 
 // use pubkey to abort an operation and unlock the server
 // this is not a secure solution
 Status FCKVClient::AbortOp() {
+  FC_TRACE_SPAN("AbortOp");
   AbortOpRequest req;
   AbortOpResponse reply;
-  ClientContext context;
 
   req.set_pubkey(hasher_(pubkey_));
-  return stub_->FCKVStoreAbortOp(&context, req, &reply);
+  req.set_namespace_id(namespace_);
+  return CallWithBackoff([&](ClientContext* context) {
+    return stub_->FCKVStoreAbortOp(context, req, &reply);
+  });
 }
 
 bool FCKVClient::CheckCompatability(std::vector<VersionStruct> versions) {
+  FC_TRACE_SPAN("CheckCompatability");
   try {
   std::sort(versions.begin(), versions.end(),
             [](const VersionStruct& a, const VersionStruct& b) {
@@ -362,16 +787,6 @@ bool FCKVClient::CheckCompatability(std::vector<VersionStruct> versions) {
   return true;
 }
 
-void sigintHandler(int sig_num)
-{
-  std::cerr << "Clean Shutdown\n";
-  //    if (srv_ptr) {
-  //        delete srv_ptr;
-  //    }
-  fflush(stdout);
-  std::exit(0);
-}
-
 bool FCKVClient::generateRSAKeyPair(std::string privateKeyFile, std::string publicKeyFile) {
     int keyLength = 2048;
     int exp = RSA_F4; // Standard RSA exponent: 65537
@@ -6,6 +6,11 @@
 #include <vector>
 #include <string>
 #include <filesystem>
+#include <functional>
+#include <set>
+
+#include "local_state.h"
+#include "thread_pool.h"
 
 using grpc::Channel;
 using grpc::ClientContext;
@@ -15,28 +20,46 @@ using fc_kv_store::FCKVStoreRPC;
 using fc_kv_store::VersionStruct;
 using fc_kv_store::KeyTable;
 
+struct FCKVClientOptions
+{
+  // Directory for persisted client state (see local_state.h). Empty keeps
+  // all state in memory, so every process starts from an empty key table.
+  // With a state directory, existing key files are reused instead of
+  // regenerated, because the persisted version struct is signed with them.
+  std::string state_dir;
+
+  // Server namespace to operate in. Clients only see version structs and
+  // contend for the lock within their own namespace.
+  std::string namespace_id;
+
+  // Threads used to verify other users' version struct signatures.
+  size_t verify_threads = 4;
+
+  // Deadline for each RPC attempt, 0 for none. The server drops requests
+  // whose deadline it cannot meet instead of doing work nobody waits for.
+  uint64_t rpc_timeout_ms = 0;
+
+  // Attempts per RPC while the server sheds load (see admission.h), backing
+  // off by its retry-after hint with exponential growth and jitter.
+  int max_attempts = 5;
+};
+
 class FCKVClient
 {
 public:
-  FCKVClient(std::shared_ptr<Channel> channel, std::string pubkey, const std::string& privateKeyFile, const std::string& publicKeyFile)
-    : stub_(FCKVStoreRPC::NewStub(channel)),
-      pubkey_(pubkey),
-      privateKeyFile_(privateKeyFile),
-      publicKeyFile_(publicKeyFile) {
-        if (std::filesystem::exists(privateKeyFile) || std::filesystem::exists(publicKeyFile)) {
-            // std::cout << "Log: Private or public key file already exists. Overwriting the files." << std::endl;
-        }
-
-        if (generateRSAKeyPair(privateKeyFile, publicKeyFile)) {
-            // std::cout << "Log: RSA key pair generated successfully." << std::endl;
-        } else {
-            throw std::runtime_error("Failed to generate RSA key pair.");
-        }
-      }
-  
+  FCKVClient(std::shared_ptr<Channel> channel, std::string pubkey, const std::string& privateKeyFile, const std::string& publicKeyFile,
+             const FCKVClientOptions& options = FCKVClientOptions());
+
   std::pair<int, std::string> Get(std::string key);
   int Put(std::string key, std::string value);
   int TamperInfo(std::string key, std::string value, int type);
+
+  // If a list of version structs is not totally ordered by >=, there is a
+  // history conflict
+  static bool CheckCompatability(std::vector<VersionStruct> versions);
+
+  // other users' signatures checked so far, structs seen before are skipped
+  uint64_t verifications() const { return verifications_; }
   
 private:
   std::unique_ptr<FCKVStoreRPC::Stub> stub_;  // gRPC
@@ -48,6 +71,25 @@ private:
 
   std::string privateKeyFile_;
   std::string publicKeyFile_;
+  std::unique_ptr<LocalState> local_state_;   // null unless options.state_dir is set
+  std::string namespace_;
+  std::string publicKeyPem_;                  // goes in our VersionStruct's pubkey
+  uint64_t rpc_timeout_ms_;
+  int max_attempts_;
+
+  // SHA-256 of serialized version structs whose signature already checked
+  // out (the pubkey is part of the struct), so unchanged structs are not
+  // verified again
+  std::set<std::string> verified_;
+  uint64_t verifications_ = 0;
+  size_t verify_threads_;
+  std::unique_ptr<ThreadPool> verify_pool_;   // started on the first batch
+
+  // last struct sent in CommitOp that we have not seen succeed, with the key
+  // table that goes with it; PreOpValidate adopts it if the server has it
+  VersionStruct pending_;
+  KeyTable pendingItable_;
+  bool hasPending_ = false;
 
   // Call PreOpValidate before any call to Get or Put
   // This function start the operation with the server and checks for
@@ -59,21 +101,56 @@ private:
   //               do we need to rollback if we abort this operation??
   Status StartOp(std::vector<VersionStruct>* versions);
   
+  // signs the version struct in place, records it as pending, then
   // releases global lock on server
   // sends updated version struct to server
-  Status CommitOp(VersionStruct version);
+  Status CommitOp(VersionStruct* version);
+
+  // checks the signature of every other user's version struct, in parallel
+  // on verify_pool_, skipping structs already in verified_; our own struct is
+  // compared byte for byte in PreOpValidate instead
+  Status VerifyVersions(const std::vector<VersionStruct>& versions);
     
   // aborts the operation - releases the lock, do not send version struct
   Status AbortOp();
-  
-  // If a list of version structs is not totally ordered by >=, there is a
-  // history conflict
-  bool CheckCompatability(std::vector<VersionStruct> versions);
 
+  // runs rpc with a fresh context (deadline, trace id) per attempt, retrying
+  // with jittered backoff while the server sheds it with RESOURCE_EXHAUSTED
+  Status CallWithBackoff(const std::function<Status(ClientContext*)>& rpc);
+  
   bool generateRSAKeyPair(std::string privateKeyFile, std::string publicKeyFile);
 
   // fetch key table from most recent version if it is different than ours
   Status UpdateItable(size_t tablehash);
+
+  // fetch a blob by hash, from local state if we have it cached
+  Status FetchBlob(size_t hash, std::string* value);
+
+  // store one blob and check the server hashed it like we did
+  Status StoreBlob(const std::string& blob, size_t* hash);
+
+  // large values are split into content-defined chunks (see chunker.h);
+  // only chunks the server doesn't have yet are uploaded, then the manifest
+  Status PutChunked(const std::string& value, size_t* manifesthash);
+
+  // fetch a manifest and reassemble the value from its verified chunks
+  Status FetchChunked(size_t manifesthash, std::string* value);
+
+  // remember a committed version struct and key table across restarts
+  void SaveLocalState();
 };
 
-void sigintHandler(int sig_num);
\ No newline at end of file
+// Server endpoint from $FC_KV_STORE_ENDPOINT, "localhost:50051" if unset.
+// Besides host:port, gRPC accepts "unix:///path/to.sock" for a server
+// started with --listen=unix:///path/to.sock.
+std::string defaultEndpoint();
+
+// Insecure channel to endpoint with the server's message size limits.
+std::shared_ptr<Channel> createChannel(const std::string& endpoint);
+
+// Clears the signature, signs the rest of the struct with the RSA key in
+// privateKeyFile and stores the signature back into the struct.
+bool signVersionStruct(VersionStruct* versionStruct, std::string privateKeyFile);
+
+// Checks the struct's signature against the PEM public key in its pubkey field.
+bool verifyVersionStruct(const VersionStruct& versionStruct);
@@ -1,4 +1,6 @@
 #include "customer.h"
+#include "log.h"
+#include "trace.h"
 
 #include <filesystem>
 #include <string>
@@ -6,17 +8,20 @@
 #include <iostream>
 #include <exception>
 
-int main()
+int main(int argc, char** argv)
 {
   // "ctrl-C handler"
-  signal(SIGINT, sigintHandler);
+  fc_log::ExitOnSignal(SIGINT);
+  fc_trace::SetProcessName("customer");
+  fc_log::SetLevelFromEnv();
 
   std::string privateKeyFile = "client_main_private_key.pem";
   std::string publicKeyFile = "client_main_public_key.pem";
 
-  const std::string target_str = "localhost:50051";
+  // endpoint from the command line, else $FC_KV_STORE_ENDPOINT
+  const std::string target_str = argc > 1 ? argv[1] : defaultEndpoint();
   FCKVClient rpcClient(
-    grpc::CreateChannel(target_str, grpc::InsecureChannelCredentials()),
+    createChannel(target_str),
     "12345", privateKeyFile, publicKeyFile);
   int user(96);
   
@@ -25,5 +30,7 @@ int main()
   auto reply = rpcClient.Get("100");
   std::cout << "BasicRPC Int received: " << reply.second + " " + placedValue << std::endl;
 
+  fc_trace::WriteChromeTraceFromEnv();
+
   return 0;
 }
\ No newline at end of file
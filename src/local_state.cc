@@ -0,0 +1,80 @@
+#include "local_state.h"
+#include "log.h"
+
+#include <leveldb/write_batch.h>
+#include <iostream>
+
+static const char* kVersionKey = "version";
+static const char* kItableKey = "itable";
+static const char* kPendingVersionKey = "pending/version";
+static const char* kPendingItableKey = "pending/itable";
+
+static std::string BlobKey(size_t hash) {
+  return "blob/" + std::to_string(hash);
+}
+
+std::unique_ptr<LocalState> LocalState::Open(const std::string& dir) {
+  leveldb::Options options;
+  options.create_if_missing = true;
+  leveldb::DB* db;
+  leveldb::Status status = leveldb::DB::Open(options, dir, &db);
+  if (!status.ok()) {
+    std::cerr << "Error opening client state with path " << dir << ": "
+              << status.ToString() << std::endl;
+    return nullptr;
+  }
+  return std::unique_ptr<LocalState>(new LocalState(db));
+}
+
+static bool LoadPair(leveldb::DB* db, const char* versionKey, const char* itableKey,
+                     VersionStruct* version, KeyTable* itable) {
+  std::string v, t;
+  if (!db->Get(leveldb::ReadOptions(), versionKey, &v).ok() ||
+      !db->Get(leveldb::ReadOptions(), itableKey, &t).ok()) {
+    return false;
+  }
+  return version->ParseFromString(v) && itable->ParseFromString(t);
+}
+
+bool LocalState::Load(VersionStruct* version, KeyTable* itable) {
+  return LoadPair(db_, kVersionKey, kItableKey, version, itable);
+}
+
+bool LocalState::LoadPending(VersionStruct* version, KeyTable* itable) {
+  return LoadPair(db_, kPendingVersionKey, kPendingItableKey, version, itable);
+}
+
+bool LocalState::Save(const VersionStruct& version, const KeyTable& itable) {
+  leveldb::WriteBatch batch;
+  batch.Put(kVersionKey, version.SerializeAsString());
+  batch.Put(kItableKey, itable.SerializeAsString());
+  batch.Delete(kPendingVersionKey);
+  batch.Delete(kPendingItableKey);
+  leveldb::Status status = db_->Write(leveldb::WriteOptions(), &batch);
+  if (!status.ok()) {
+    FC_LOG(kError) << "Error saving client state: " << status.ToString();
+  }
+  return status.ok();
+}
+
+bool LocalState::SavePending(const VersionStruct& version, const KeyTable& itable) {
+  leveldb::WriteBatch batch;
+  batch.Put(kPendingVersionKey, version.SerializeAsString());
+  batch.Put(kPendingItableKey, itable.SerializeAsString());
+  // must be on disk before the server can commit it
+  leveldb::WriteOptions options;
+  options.sync = true;
+  leveldb::Status status = db_->Write(options, &batch);
+  if (!status.ok()) {
+    FC_LOG(kError) << "Error saving pending commit: " << status.ToString();
+  }
+  return status.ok();
+}
+
+bool LocalState::GetBlob(size_t hash, std::string* value) {
+  return db_->Get(leveldb::ReadOptions(), BlobKey(hash), value).ok();
+}
+
+void LocalState::PutBlob(size_t hash, const std::string& value) {
+  db_->Put(leveldb::WriteOptions(), BlobKey(hash), value);
+}
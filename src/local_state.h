@@ -0,0 +1,48 @@
+#pragma once
+
+#include "fc_kv_store.pb.h"
+
+#include <leveldb/db.h>
+#include <memory>
+#include <string>
+
+using fc_kv_store::VersionStruct;
+using fc_kv_store::KeyTable;
+
+// Client-side persistent state, kept in a small LevelDB under the client's
+// state directory. It holds the last committed (signed) version struct, the
+// key table that goes with it, and a cache of blobs we have already seen, so
+// a restarted client only has to fetch what changed while it was down.
+//
+// A struct is also recorded as pending right before it is sent in CommitOp.
+// If the client dies, or loses the reply, after the server committed it, the
+// server holds a struct the last saved one does not match; the pending one
+// lets the restarted client recognise that struct as its own.
+class LocalState
+{
+public:
+  static std::unique_ptr<LocalState> Open(const std::string& dir);
+  ~LocalState() { delete db_; }
+
+  // Returns false if nothing has been saved yet.
+  bool Load(VersionStruct* version, KeyTable* itable);
+
+  // Saves version and itable together in one atomic write, dropping any
+  // pending commit.
+  bool Save(const VersionStruct& version, const KeyTable& itable);
+
+  // Records a signed struct and its key table about to be committed.
+  bool SavePending(const VersionStruct& version, const KeyTable& itable);
+
+  // Returns false if there is no pending commit.
+  bool LoadPending(VersionStruct* version, KeyTable* itable);
+
+  // Blobs are content addressed, callers must only cache verified blobs.
+  bool GetBlob(size_t hash, std::string* value);
+  void PutBlob(size_t hash, const std::string& value);
+
+private:
+  explicit LocalState(leveldb::DB* db) : db_(db) {}
+
+  leveldb::DB* db_;
+};
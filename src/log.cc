@@ -0,0 +1,243 @@
+#include "log.h"
+
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fc_log {
+
+std::atomic<int> runtime_level{kInfo};
+
+struct Record {
+  uint8_t level;
+  uint16_t len;
+  int line;
+  const char* file;   // __FILE__, a string literal
+  uint64_t time_us;
+  char text[kMaxLineSize];
+};
+
+// Single producer (the owning thread), single consumer (whoever holds
+// State::mu, normally the writer thread). head and tail only ever grow.
+struct ThreadRing {
+  std::atomic<uint64_t> head{0};
+  std::atomic<uint64_t> tail{0};
+  std::atomic<bool> orphaned{false};   // owning thread has exited
+  std::vector<Record> slots = std::vector<Record>(kRingSlots);
+};
+
+struct State {
+  std::mutex mu;   // consumer side: registry, draining, output
+  std::vector<std::shared_ptr<ThreadRing>> registry;
+  FILE* out = stderr;
+  uint64_t reported_dropped = 0;
+
+  std::thread writer;
+  std::condition_variable cv;
+  bool stop = false;
+};
+
+static std::atomic<uint64_t> dropped{0};
+
+// never destroyed: handler threads may still log while the process exits
+static State* state = new State;
+
+static void DrainLocked() {
+  static const char kLetters[] = "DIWE";
+  for (size_t i = 0; i < state->registry.size();) {
+    ThreadRing* ring = state->registry[i].get();
+    bool orphaned = ring->orphaned.load(std::memory_order_acquire);
+    uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    for (; tail < head; tail++) {
+      const Record& r = ring->slots[tail % kRingSlots];
+      time_t secs = r.time_us / 1000000;
+      struct tm tm;
+      localtime_r(&secs, &tm);
+      char stamp[32];
+      strftime(stamp, sizeof(stamp), "%m%d %H:%M:%S", &tm);
+      const char* base = strrchr(r.file, '/');
+      fprintf(state->out, "%c%s.%06llu %s:%d] %.*s\n", kLetters[r.level], stamp,
+              (unsigned long long)(r.time_us % 1000000), base ? base + 1 : r.file, r.line,
+              (int)r.len, r.text);
+    }
+    ring->tail.store(tail, std::memory_order_release);
+    if (orphaned) {
+      state->registry.erase(state->registry.begin() + i);
+    } else {
+      i++;
+    }
+  }
+  uint64_t lost = dropped.load(std::memory_order_relaxed);
+  if (lost != state->reported_dropped) {
+    fprintf(state->out, "W dropped %llu log lines\n",
+            (unsigned long long)(lost - state->reported_dropped));
+    state->reported_dropped = lost;
+  }
+  fflush(state->out);
+}
+
+static void WriterLoop() {
+  // a handler interrupting this thread while it holds mu could deadlock
+  sigset_t all;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, nullptr);
+
+  std::unique_lock<std::mutex> guard(state->mu);
+  while (!state->stop) {
+    DrainLocked();
+    state->cv.wait_for(guard, std::chrono::milliseconds(2));
+  }
+}
+
+static void Shutdown() {
+  {
+    std::lock_guard<std::mutex> guard(state->mu);
+    state->stop = true;
+  }
+  state->cv.notify_all();
+  if (state->writer.joinable()) {
+    state->writer.join();
+  }
+  Flush();
+}
+
+// marks the ring orphaned at thread exit; the writer frees it once drained
+struct RingHolder {
+  std::shared_ptr<ThreadRing> ring;
+  ~RingHolder() {
+    if (ring) {
+      ring->orphaned.store(true, std::memory_order_release);
+    }
+  }
+};
+
+static ThreadRing* LocalRing() {
+  thread_local RingHolder holder;
+  if (!holder.ring) {
+    holder.ring = std::make_shared<ThreadRing>();
+    std::lock_guard<std::mutex> guard(state->mu);
+    state->registry.push_back(holder.ring);
+    if (!state->writer.joinable() && !state->stop) {
+      state->writer = std::thread(WriterLoop);
+      std::atexit(Shutdown);
+    }
+  }
+  return holder.ring.get();
+}
+
+Message::Message(Level level, const char* file, int line)
+  : level_(level),
+    file_(file),
+    line_(line),
+    stream_(&buf_) {
+}
+
+Message::~Message() {
+  ThreadRing* ring = LocalRing();
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  if (head - ring->tail.load(std::memory_order_acquire) >= kRingSlots) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  Record& r = ring->slots[head % kRingSlots];
+  r.level = level_;
+  r.len = buf_.size();
+  r.file = file_;
+  r.line = line_;
+  r.time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+  memcpy(r.text, buf_.data(), r.len);
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+void SetLevel(Level level) {
+  runtime_level.store(level, std::memory_order_relaxed);
+}
+
+bool SetLevelByName(const char* name) {
+  static const char* kNames[] = {"debug", "info", "warn", "error", "off"};
+  for (int i = kDebug; i <= kOff; i++) {
+    if (strcmp(name, kNames[i]) == 0) {
+      SetLevel((Level)i);
+      return true;
+    }
+  }
+  return false;
+}
+
+void SetLevelFromEnv() {
+  const char* name = std::getenv("FC_KV_LOG_LEVEL");
+  if (name && *name) {
+    SetLevelByName(name);
+  }
+}
+
+void SetOutput(FILE* out) {
+  std::lock_guard<std::mutex> guard(state->mu);
+  DrainLocked();
+  state->out = out;
+}
+
+void Flush() {
+  std::lock_guard<std::mutex> guard(state->mu);
+  DrainLocked();
+}
+
+uint64_t Dropped() {
+  return dropped.load(std::memory_order_relaxed);
+}
+
+static int exit_pipe[2] = {-1, -1};
+static std::atomic<void (*)()> exit_hook{nullptr};
+
+static void ExitSignalHandler(int) {
+  // write() is async-signal-safe, everything else happens on the watcher
+  char c = 0;
+  ssize_t ignored = write(exit_pipe[1], &c, 1);
+  (void)ignored;
+}
+
+static void ExitWatcher() {
+  sigset_t all;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, nullptr);
+
+  char c;
+  while (read(exit_pipe[0], &c, 1) < 0 && errno == EINTR) {
+  }
+  fputs("Clean Shutdown\n", stderr);
+  if (auto hook = exit_hook.load()) {
+    hook();
+  }
+  Flush();
+  fflush(stdout);
+  std::exit(0);
+}
+
+void ExitOnSignal(int sig, void (*before_exit)()) {
+  static std::once_flag once;
+  std::call_once(once, [] {
+    if (pipe(exit_pipe) != 0) {
+      return;
+    }
+    std::thread(ExitWatcher).detach();
+  });
+  if (exit_pipe[1] < 0) {
+    return;
+  }
+  exit_hook.store(before_exit);
+  signal(sig, ExitSignalHandler);
+}
+
+}  // namespace fc_log
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <ostream>
+#include <streambuf>
+
+// Leveled, asynchronous logging for request paths.
+//
+//   FC_LOG(kWarn) << "Put failed: " << status.error_message();
+//
+// A message is formatted into a fixed-size buffer on the stack and pushed
+// onto a single-producer ring owned by the calling thread, so logging never
+// takes a lock or touches the output stream on the caller's thread. One
+// background thread drains every ring and writes the lines out. A full ring
+// drops the line (and counts it) instead of blocking the handler.
+//
+// Levels below FC_LOG_MIN_LEVEL are compiled out entirely; the rest are
+// checked against the runtime level (SetLevel, or $FC_KV_LOG_LEVEL) with a
+// single relaxed load, and the stream arguments of a disabled FC_LOG are
+// never evaluated.
+namespace fc_log {
+
+enum Level { kDebug = 0, kInfo = 1, kWarn = 2, kError = 3, kOff = 4 };
+
+#ifndef FC_LOG_MIN_LEVEL
+#define FC_LOG_MIN_LEVEL 0
+#endif
+
+constexpr size_t kMaxLineSize = 240;   // longer messages are truncated
+constexpr size_t kRingSlots = 1024;    // lines buffered per thread
+
+extern std::atomic<int> runtime_level;
+
+inline bool IsOn(Level level) {
+  return level >= FC_LOG_MIN_LEVEL && level >= runtime_level.load(std::memory_order_relaxed);
+}
+
+void SetLevel(Level level);
+// debug|info|warn|error|off; returns false and leaves the level alone otherwise
+bool SetLevelByName(const char* name);
+// Reads $FC_KV_LOG_LEVEL if it is set.
+void SetLevelFromEnv();
+
+// Where the writer thread puts lines, stderr by default.
+void SetOutput(FILE* out);
+
+// Writes out everything logged so far by any thread. Normal exit drains on
+// its own. Takes a lock, so never call it from a signal handler.
+void Flush();
+
+// Makes sig shut the process down cleanly. The handler only writes a byte to
+// a self-pipe; a watcher thread then runs before_exit (may be null), drains
+// the log and exits.
+void ExitOnSignal(int sig, void (*before_exit)() = nullptr);
+
+// lines lost to full rings since startup
+uint64_t Dropped();
+
+// streambuf over a fixed array, silently truncating
+class LineBuf : public std::streambuf
+{
+public:
+  LineBuf() { setp(buf_, buf_ + kMaxLineSize); }
+  const char* data() const { return buf_; }
+  size_t size() const { return pptr() - pbase(); }
+
+private:
+  char buf_[kMaxLineSize];
+};
+
+// One log line, queued when it goes out of scope.
+class Message
+{
+public:
+  Message(Level level, const char* file, int line);
+  ~Message();
+  std::ostream& stream() { return stream_; }
+
+private:
+  Level level_;
+  const char* file_;
+  int line_;
+  LineBuf buf_;
+  std::ostream stream_;
+};
+
+}  // namespace fc_log
+
+#define FC_LOG(level)                                  \
+  if (!fc_log::IsOn(fc_log::level))                    \
+    ;                                                  \
+  else                                                 \
+    fc_log::Message(fc_log::level, __FILE__, __LINE__).stream()
@@ -0,0 +1,208 @@
+#include "blob_store.h"
+#include "log.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+
+// On-disk record: header followed by len bytes of value.
+struct RecordHeader {
+  uint64_t key;
+  uint64_t len;
+};
+
+static bool WriteAll(int fd, const char* data, size_t len, uint64_t offset) {
+  while (len > 0) {
+    ssize_t n = pwrite(fd, data, len, offset);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += n;
+    len -= n;
+    offset += n;
+  }
+  return true;
+}
+
+std::unique_ptr<LogBlobStore> LogBlobStore::Open(const std::string& dir, bool sync) {
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  if (ec) {
+    std::cerr << "Failed to create blob log directory " << dir << ": " << ec.message() << std::endl;
+    return nullptr;
+  }
+  std::unique_ptr<LogBlobStore> store(new LogBlobStore(dir, sync));
+  if (!store->Recover()) {
+    return nullptr;
+  }
+  return store;
+}
+
+LogBlobStore::~LogBlobStore() {
+  for (auto& seg : segments_) {
+    if (seg.map) munmap(seg.map, seg.map_len);
+    if (seg.fd >= 0) close(seg.fd);
+  }
+}
+
+std::string LogBlobStore::SegmentPath(uint32_t id) const {
+  char name[32];
+  snprintf(name, sizeof(name), "segment-%06u.log", id);
+  return dir_ + "/" + name;
+}
+
+bool LogBlobStore::Recover() {
+  std::vector<uint32_t> ids;
+  for (auto& entry : std::filesystem::directory_iterator(dir_)) {
+    unsigned id;
+    if (sscanf(entry.path().filename().c_str(), "segment-%06u.log", &id) == 1) {
+      ids.push_back(id);
+    }
+  }
+  std::sort(ids.begin(), ids.end());
+
+  for (size_t i = 0; i < ids.size(); i++) {
+    // segment ids are dense, a gap means files were removed underneath us
+    if (ids[i] != i) {
+      std::cerr << "Blob log is missing segment " << i << std::endl;
+      return false;
+    }
+    Segment seg;
+    if (!RecoverSegment(&seg, ids[i])) {
+      return false;
+    }
+    segments_.push_back(seg);
+  }
+
+  if (segments_.empty()) {
+    return AddSegment(0);
+  }
+  return true;
+}
+
+bool LogBlobStore::RecoverSegment(Segment* seg, uint32_t id) {
+  std::string path = SegmentPath(id);
+  seg->fd = open(path.c_str(), O_RDWR);
+  if (seg->fd < 0) {
+    std::cerr << "Failed to open blob log segment " << path << std::endl;
+    return false;
+  }
+  struct stat st;
+  fstat(seg->fd, &st);
+  uint64_t file_size = st.st_size;
+
+  seg->map_len = std::max<size_t>(kSegmentBytes, file_size);
+  void* map = mmap(nullptr, seg->map_len, PROT_READ, MAP_SHARED, seg->fd, 0);
+  if (map == MAP_FAILED) {
+    std::cerr << "Failed to mmap blob log segment " << path << std::endl;
+    return false;
+  }
+  seg->map = (char*)map;
+
+  // later records for the same key win, so scanning in order leaves the
+  // index pointing at the newest copy
+  uint64_t offset = 0;
+  while (offset + sizeof(RecordHeader) <= file_size) {
+    RecordHeader header;
+    memcpy(&header, seg->map + offset, sizeof(header));
+    uint64_t value_offset = offset + sizeof(RecordHeader);
+    if (header.len > file_size - value_offset) {
+      break;
+    }
+    index_[header.key] = Location{id, value_offset, header.len};
+    offset = value_offset + header.len;
+  }
+
+  // drop a torn record left by a crash mid-append
+  if (offset != file_size) {
+    std::cerr << "Truncating torn record at " << path << ":" << offset << std::endl;
+    if (ftruncate(seg->fd, offset) != 0) {
+      return false;
+    }
+  }
+  seg->size = offset;
+  return true;
+}
+
+bool LogBlobStore::AddSegment(size_t min_bytes) {
+  uint32_t id = segments_.size();
+  std::string path = SegmentPath(id);
+  Segment seg;
+  seg.fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (seg.fd < 0) {
+    FC_LOG(kError) << "Failed to create blob log segment " << path;
+    return false;
+  }
+  // map the whole segment up front; mapping past EOF is fine as long as we
+  // only read bytes that have been written, and it saves remapping on growth
+  seg.map_len = std::max(kSegmentBytes, min_bytes);
+  void* map = mmap(nullptr, seg.map_len, PROT_READ, MAP_SHARED, seg.fd, 0);
+  if (map == MAP_FAILED) {
+    close(seg.fd);
+    return false;
+  }
+  seg.map = (char*)map;
+  segments_.push_back(seg);
+  return true;
+}
+
+bool LogBlobStore::Get(size_t key, std::string* value) {
+  std::shared_lock<std::shared_mutex> guard(mu_);
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    return false;
+  }
+  const Location& loc = it->second;
+  value->assign(segments_[loc.segment].map + loc.offset, loc.len);
+  return true;
+}
+
+bool LogBlobStore::Put(size_t key, const std::string& value) {
+  std::unique_lock<std::shared_mutex> guard(mu_);
+
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    const Location& loc = it->second;
+    if (loc.len == value.size() &&
+        memcmp(segments_[loc.segment].map + loc.offset, value.data(), loc.len) == 0) {
+      return true;
+    }
+  }
+
+  uint64_t record_len = sizeof(RecordHeader) + value.size();
+  if (segments_.back().size + record_len > segments_.back().map_len) {
+    if (!AddSegment(record_len)) {
+      return false;
+    }
+  }
+  Segment& seg = segments_.back();
+
+  RecordHeader header{key, value.size()};
+  // a failed write leaves seg.size alone, so the next append overwrites it
+  if (!WriteAll(seg.fd, (const char*)&header, sizeof(header), seg.size) ||
+      !WriteAll(seg.fd, value.data(), value.size(), seg.size + sizeof(header))) {
+    FC_LOG(kError) << "Failed to append to blob log: " << strerror(errno);
+    ftruncate(seg.fd, seg.size);
+    return false;
+  }
+  if (sync_) {
+    fdatasync(seg.fd);
+  }
+
+  index_[key] = Location{(uint32_t)(segments_.size() - 1), seg.size + sizeof(header), value.size()};
+  seg.size += record_len;
+  return true;
+}
+
+bool LogBlobStore::Contains(size_t key) {
+  std::shared_lock<std::shared_mutex> guard(mu_);
+  return index_.count(key) > 0;
+}
@@ -2,8 +2,17 @@
 
 #include <grpcpp/ext/proto_server_reflection_plugin.h>
 #include <grpcpp/grpcpp.h>
-#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
 #include "server.h"
+#include "log.h"
+#include "trace.h"
 
 using grpc::Server;
 using grpc::ServerBuilder;
@@ -13,27 +22,75 @@ using grpc::ServerReaderWriter;
 using grpc::ServerWriter;
 using grpc::Status;
 
+FCKVStoreRPCServiceImpl::Namespace* FCKVStoreRPCServiceImpl::FindNamespace(const std::string& id) {
+  std::shared_lock<std::shared_mutex> guard(namespaces_mu_);
+  auto it = namespaces_.find(id);
+  return it == namespaces_.end() ? nullptr : it->second.get();
+}
+
+FCKVStoreRPCServiceImpl::Namespace* FCKVStoreRPCServiceImpl::GetNamespace(const std::string& id) {
+  if (Namespace* ns = FindNamespace(id)) {
+    return ns;
+  }
+  std::unique_lock<std::shared_mutex> guard(namespaces_mu_);
+  auto& ns = namespaces_[id];
+  if (!ns) {
+    ns = std::make_unique<Namespace>();
+  }
+  return ns.get();
+}
+
+Status FCKVStoreRPCServiceImpl::Reject(ServerContext* context,
+                                       const AdmissionController::Ticket& ticket) {
+  if (ticket.retry_after_ms()) {
+    context->AddTrailingMetadata(AdmissionController::kRetryAfterMetadataKey,
+                                 std::to_string(ticket.retry_after_ms()));
+  }
+  return ticket.status();
+}
+
 Status FCKVStoreRPCServiceImpl::FCKVStoreStartOp(
   ServerContext* context, const StartOpRequest* req, StartOpResponse* res) {
-  if (lock_ == 0) {
-    lock_ = req->pubkey();
-  
-    for (auto& [pubkey, vs] : vsl_) {
+  FC_TRACE_EXTRACT(context);
+  FC_TRACE_SPAN("Server.StartOp");
+  AdmissionController::Ticket ticket(&admission_, AdmissionController::kStartOp, context->deadline());
+  if (!ticket.admitted()) {
+    return Reject(context, ticket);
+  }
+  Namespace* ns = GetNamespace(req->namespace_id());
+  ns->start_ops++;
+  size_t unlocked = 0;
+  if (ns->lock.compare_exchange_strong(unlocked, req->pubkey())) {
+    std::lock_guard<std::mutex> guard(ns->vsl_mu);
+    for (auto& [pubkey, vs] : ns->vsl) {
       res->add_versions(vs);
     }
     return Status::OK;
   } else {
+    ns->lock_conflicts++;
     return Status(grpc::StatusCode::UNAVAILABLE, "");
   }
 }
   
 Status FCKVStoreRPCServiceImpl::FCKVStoreCommitOp(
   ServerContext* context, const CommitOpRequest* req, CommitOpResponse* res) {
-  if (lock_ == req->pubkey()) {
+  FC_TRACE_EXTRACT(context);
+  FC_TRACE_SPAN("Server.CommitOp");
+  AdmissionController::Ticket ticket(&admission_, AdmissionController::kCommitOp, context->deadline());
+  if (!ticket.admitted()) {
+    return Reject(context, ticket);
+  }
+  Namespace* ns = FindNamespace(req->namespace_id());
+  if (ns && ns->lock == req->pubkey()) {
     std::string version;
     req->v().SerializeToString(&version);
-    vsl_[req->pubkey()] = version;
-    lock_ = 0;
+    {
+      std::lock_guard<std::mutex> guard(ns->vsl_mu);
+      ns->vsl[req->pubkey()] = version;
+    }
+    ns->itable_root = req->v().itablehash();
+    ns->commits++;
+    ns->lock = 0;
     return Status::OK;
   } else {
     return Status(grpc::StatusCode::UNAVAILABLE, "");
@@ -42,8 +99,16 @@ Status FCKVStoreRPCServiceImpl::FCKVStoreCommitOp(
 
 Status FCKVStoreRPCServiceImpl::FCKVStoreAbortOp(
   ServerContext* context, const AbortOpRequest* req, AbortOpResponse* res) {
-  if (lock_ == req->pubkey()) {
-    lock_ = 0;
+  FC_TRACE_EXTRACT(context);
+  FC_TRACE_SPAN("Server.AbortOp");
+  AdmissionController::Ticket ticket(&admission_, AdmissionController::kAbortOp, context->deadline());
+  if (!ticket.admitted()) {
+    return Reject(context, ticket);
+  }
+  Namespace* ns = FindNamespace(req->namespace_id());
+  if (ns && ns->lock == req->pubkey()) {
+    ns->aborts++;
+    ns->lock = 0;
     return Status::OK;
   } else {
     return Status(grpc::StatusCode::UNAVAILABLE, "");
@@ -52,18 +117,32 @@ Status FCKVStoreRPCServiceImpl::FCKVStoreAbortOp(
     
 Status FCKVStoreRPCServiceImpl::FCKVStoreGet(
   ServerContext* context, const GetRequest* request, GetResponse* reply) {
-  if (lock_ == request->pubkey()) {
-    leveldb::Status status;
+  FC_TRACE_EXTRACT(context);
+  FC_TRACE_SPAN("Server.Get");
+  AdmissionController::Ticket ticket(&admission_, AdmissionController::kGet, context->deadline());
+  if (!ticket.admitted()) {
+    return Reject(context, ticket);
+  }
+  Namespace* ns = FindNamespace(request->namespace_id());
+  if (ns && ns->lock == request->pubkey()) {
+    ns->gets++;
     std::string value;
-    std::string key = std::to_string(request->key());
-    status = store_->Get(leveldb::ReadOptions(), key.c_str(), &value);
-    if (status.ok()) {
-      std::cout << "Store Get OK" << std::endl;
+    if (cache_.Lookup(request->key(), &value)) {
+      reply->set_value(value);
+      return Status::OK;
+    }
+    bool found;
+    {
+      FC_TRACE_SPAN("Store.Get");
+      found = store_->Get(request->key(), &value);
+    }
+    if (found) {
+      FC_LOG(kDebug) << "Store Get OK";
+      cache_.Insert(request->key(), value);
       reply->set_value(value);
       return Status::OK;
     }
-    std::cout << "LevelDB error: " << status.ToString() << std::endl;
-    std::cout << "Server Get error with key " << key << std::endl;
+    FC_LOG(kWarn) << "Server Get error with key " << request->key();
     return Status(grpc::StatusCode::NOT_FOUND, "");
   } else {
     return Status(grpc::StatusCode::UNAVAILABLE, "");
@@ -72,42 +151,75 @@ Status FCKVStoreRPCServiceImpl::FCKVStoreGet(
 
 Status FCKVStoreRPCServiceImpl::FCKVStorePut(
   ServerContext* context, const PutRequest* request, PutResponse* reply) {
-  if (lock_ == request->pubkey()) {
-    std::cout << "Server in put method" << std::endl;
-    leveldb::Status status;
+  FC_TRACE_EXTRACT(context);
+  FC_TRACE_SPAN("Server.Put");
+  AdmissionController::Ticket ticket(&admission_, AdmissionController::kPut, context->deadline());
+  if (!ticket.admitted()) {
+    return Reject(context, ticket);
+  }
+  Namespace* ns = FindNamespace(request->namespace_id());
+  if (ns && ns->lock == request->pubkey()) {
+    ns->puts++;
+    FC_LOG(kDebug) << "Server in put method";
+    bool ok = true;
     std::string val = request->value();
     size_t hashval = hasher_(val);
 
-    if(tamper_info_ != ServerTamperInfoHideUpdate)
-      status = store_->Put(leveldb::WriteOptions(), std::to_string(hashval), val);
+    if(tamper_info_ != ServerTamperInfoHideUpdate) {
+      FC_TRACE_SPAN("Store.Put");
+      ok = store_->Put(hashval, val);
+    }
 
-    if (status.ok()) {
-      std::cout << "Store Put OK" << std::endl;
+    if (ok) {
+      FC_LOG(kDebug) << "Store Put OK";
+      if (tamper_info_ != ServerTamperInfoHideUpdate)
+        cache_.Insert(hashval, val);
       reply->set_hash(hashval);
       return Status::OK;
     }
-    std::cout << "Server Put error with key " << hashval << std::endl;
+    FC_LOG(kError) << "Server Put error with key " << hashval;
     return Status(grpc::StatusCode::UNKNOWN, "");
   } else {
     return Status(grpc::StatusCode::UNAVAILABLE, "");
   }
 }
 
+Status FCKVStoreRPCServiceImpl::FCKVStoreHasBlobs(
+  ServerContext* context, const HasBlobsRequest* request, HasBlobsResponse* reply) {
+  FC_TRACE_EXTRACT(context);
+  FC_TRACE_SPAN("Server.HasBlobs");
+  AdmissionController::Ticket ticket(&admission_, AdmissionController::kHasBlobs, context->deadline());
+  if (!ticket.admitted()) {
+    return Reject(context, ticket);
+  }
+  Namespace* ns = FindNamespace(request->namespace_id());
+  if (ns && ns->lock == request->pubkey()) {
+    for (uint64_t hash : request->hashes()) {
+      if (!store_->Contains(hash)) {
+        reply->add_missing(hash);
+      }
+    }
+    return Status::OK;
+  } else {
+    return Status(grpc::StatusCode::UNAVAILABLE, "");
+  }
+}
+
   Status FCKVStoreRPCServiceImpl::FCKVServerTamperInfo(ServerContext* context, const TamperInfoRequest* request,
                       TamperInfoResponse* reply) {
 
   tamper_info_ = (ServerTamperInfo)request->tampertype();
   if(tamper_info_ == ServerTamperInfoBadData)
   {
-    std::cout << "Server in TamperInfo method" << std::endl;
-    leveldb::Status status;
+    FC_LOG(kDebug) << "Server in TamperInfo method";
     std::string val = request->value();
     size_t hashval = hasher_(val);
     std::string data = ""; // let's put NULL
-    status = store_->Put(leveldb::WriteOptions(), std::to_string(hashval), data);
 
-    if (status.ok()) {
-      std::cout << "TamperInfo ServerTamperInfoBadData OK" << std::endl;
+    if (store_->Put(hashval, data)) {
+      // the cache must serve the tampered blob too, or the tamper is invisible
+      cache_.Insert(hashval, data);
+      FC_LOG(kInfo) << "TamperInfo ServerTamperInfoBadData OK";
       reply->set_value(0); // success/
       return Status::OK;
     }
@@ -115,61 +227,119 @@ Status FCKVStoreRPCServiceImpl::FCKVStorePut(
   else if(tamper_info_ == ServerTamperInfoHideUpdate)
   {
     // Puts will fail now.
-    std::cout << "TamperInfo ServerTamperInfoHideUpdate OK" << std::endl;
+    FC_LOG(kInfo) << "TamperInfo ServerTamperInfoHideUpdate OK";
     reply->set_value(0); // success/
     return Status::OK;
   }
   else
   {
      // Nothing will fail now.
-    std::cout << "TamperInfo ServerTamperInfoNone OK" << std::endl;
+    FC_LOG(kInfo) << "TamperInfo ServerTamperInfoNone OK";
     reply->set_value(0); // success/
     return Status::OK;
   }
 
-  std::cout << "Server TamperInfo error with tamper_info_ " << tamper_info_ << std::endl;
+  FC_LOG(kError) << "Server TamperInfo error with tamper_info_ " << tamper_info_;
   return Status(grpc::StatusCode::UNKNOWN, "");
   
 }
 
-void sigintHandler(int sig_num)
+Status FCKVStoreRPCServiceImpl::FCKVServerStats(
+  ServerContext* context, const ServerStatsRequest* request, ServerStatsResponse* reply) {
+  reply->set_cache_hits(cache_.hits());
+  reply->set_cache_misses(cache_.misses());
+  reply->set_cache_usage_bytes(cache_.usage_bytes());
+  reply->set_cache_capacity_bytes(cache_.capacity_bytes());
+  reply->set_admission_shed(admission_.shed());
+  reply->set_admission_expired(admission_.expired());
+  {
+    std::shared_lock<std::shared_mutex> guard(namespaces_mu_);
+    reply->set_namespaces(namespaces_.size());
+  }
+
+  // an unknown namespace has all zero stats, and asking must not create it
+  Namespace* ns = FindNamespace(request->namespace_id());
+  if (!ns) {
+    return Status::OK;
+  }
+  reply->set_start_ops(ns->start_ops);
+  reply->set_lock_conflicts(ns->lock_conflicts);
+  reply->set_commits(ns->commits);
+  reply->set_aborts(ns->aborts);
+  reply->set_gets(ns->gets);
+  reply->set_puts(ns->puts);
+  reply->set_itable_root(ns->itable_root);
+  {
+    std::lock_guard<std::mutex> guard(ns->vsl_mu);
+    reply->set_users(ns->vsl.size());
+  }
+  return Status::OK;
+}
+
+// Makes path free to bind a unix socket on. A socket file left behind by a
+// previous run would make bind fail, so it is removed, but only once a
+// connect() is refused: a live server keeps its socket. Returns false with a
+// message on stderr if the path is in use or not a socket.
+static bool ClearSocketPath(const std::string& path)
 {
-  std::cerr << "Clean Shutdown\n";
-  //    if (srv_ptr) {
-  //        delete srv_ptr;
-  //    }
-  fflush(stdout);
-  std::exit(0);
+  struct stat st;
+  if (lstat(path.c_str(), &st) != 0) {
+    return true;
+  }
+  if (!S_ISSOCK(st.st_mode)) {
+    std::cerr << path << " exists and is not a socket" << std::endl;
+    return false;
+  }
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "Socket path too long: " << path << std::endl;
+    return false;
+  }
+  memcpy(addr.sun_path, path.c_str(), path.size());
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    std::cerr << "Cannot check socket " << path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+  int rc = connect(fd, (sockaddr*)&addr, sizeof(addr));
+  int err = errno;
+  close(fd);
+  if (rc == 0) {
+    std::cerr << "Another server is listening on " << path << std::endl;
+    return false;
+  }
+  if (err != ECONNREFUSED) {
+    std::cerr << "Cannot check socket " << path << ": " << strerror(err) << std::endl;
+    return false;
+  }
+  return unlink(path.c_str()) == 0 || errno == ENOENT;
 }
 
-void run_server()
+std::unique_ptr<Server> start_server(FCKVStoreRPCServiceImpl* service,
+                                     const std::vector<std::string>& addresses)
 {
-  std::string server_address("localhost:50051");
-  FCKVStoreRPCServiceImpl service;
-  //  grpc::reflection::InitProtoReflectionServerBuilderPlugin();
   ServerBuilder builder;
-  // Listen on the given address without any authentication mechanism.
-  builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
-  builder.SetMaxSendMessageSize(INT_MAX);
-  builder.SetMaxReceiveMessageSize(INT_MAX);
-  builder.SetMaxMessageSize(INT_MAX);
+  for (auto& address : addresses) {
+    std::string path;
+    if (address.rfind("unix://", 0) == 0) {
+      path = address.substr(strlen("unix://"));
+    } else if (address.rfind("unix:", 0) == 0) {
+      path = address.substr(strlen("unix:"));
+    }
+    if (!path.empty() && !ClearSocketPath(path)) {
+      return nullptr;
+    }
+    // Listen on the given address without any authentication mechanism.
+    builder.AddListeningPort(address, grpc::InsecureServerCredentials());
+  }
+  builder.SetMaxSendMessageSize(kFCKVMaxMessageSize);
+  builder.SetMaxReceiveMessageSize(kFCKVMaxMessageSize);
+  builder.SetMaxMessageSize(kFCKVMaxMessageSize);
 
   // Register "service" as the instance through which we'll communicate with
   // clients. In this case it corresponds to an *synchronous* service.
-  builder.RegisterService(&service);
+  builder.RegisterService(service);
   // Finally assemble the server.
-  std::unique_ptr<Server> server(builder.BuildAndStart());
-  std::cout << "Server listening on " << server_address << std::endl;
-
-  // Wait for the server to shutdown. Note that some other thread must be
-  // responsible for shutting down the server for this call to ever return.
-  server->Wait();
-}
-
-int main()
-{
-  // "ctrl-C handler"
-  signal(SIGINT, sigintHandler);
-  run_server();
-  return 0;
+  return builder.BuildAndStart();
 }
@@ -2,9 +2,18 @@
 
 #include <grpcpp/ext/proto_server_reflection_plugin.h>
 #include <grpcpp/grpcpp.h>
-#include <leveldb/db.h>
 #include <atomic>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
 #include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "admission.h"
+#include "blob_cache.h"
+#include "blob_store.h"
+#include "channel_args.h"
 
 using grpc::Server;
 using grpc::ServerBuilder;
@@ -19,6 +28,8 @@ using fc_kv_store::GetRequest;
 using fc_kv_store::GetResponse;
 using fc_kv_store::PutRequest;
 using fc_kv_store::PutResponse;
+using fc_kv_store::HasBlobsRequest;
+using fc_kv_store::HasBlobsResponse;
 using fc_kv_store::StartOpRequest;
 using fc_kv_store::StartOpResponse;
 using fc_kv_store::CommitOpRequest;
@@ -29,19 +40,25 @@ using fc_kv_store::VersionStruct;
 
 using fc_kv_store::TamperInfoRequest;
 using fc_kv_store::TamperInfoResponse;
+using fc_kv_store::ServerStatsRequest;
+using fc_kv_store::ServerStatsResponse;
 
 
 class FCKVStoreRPCServiceImpl final : public FCKVStoreRPC::Service
 {
 public:
-  FCKVStoreRPCServiceImpl()
-    : lock_(0) {
-    leveldb::Options options;
-    options.create_if_missing = true;
-    std::string dbPath = "/tmp/kv_store";
-    leveldb::Status status = leveldb::DB::Open(options, dbPath,  &store_);
-    if (!status.ok()) {
-      std::cout << "Error opening leveldb with path " << dbPath << std::endl;
+  // engine and path are passed to BlobStore::Open, see blob_store.h;
+  // max_in_flight caps concurrent requests per RPC type, see admission.h
+  explicit FCKVStoreRPCServiceImpl(const std::string& engine = "leveldb",
+                                   const std::string& path = "",
+                                   size_t cache_bytes = BlobCache::kDefaultCapacityBytes,
+                                   size_t max_in_flight = AdmissionController::kDefaultMaxInFlight)
+    : store_(BlobStore::Open(engine, path)),
+      cache_(cache_bytes),
+      admission_(max_in_flight),
+      tamper_info_(ServerTamperInfoNone) {
+    if (!store_) {
+      throw std::runtime_error("Failed to open " + engine + " blob store.");
     }
   }
 
@@ -60,9 +77,15 @@ public:
   Status FCKVStorePut(ServerContext* context, const PutRequest* request,
                       PutResponse* reply) override;
 
+  Status FCKVStoreHasBlobs(ServerContext* context, const HasBlobsRequest* request,
+                           HasBlobsResponse* reply) override;
+
   Status FCKVServerTamperInfo(ServerContext* context, const TamperInfoRequest* request,
                       TamperInfoResponse* reply) override;
 
+  Status FCKVServerStats(ServerContext* context, const ServerStatsRequest* request,
+                      ServerStatsResponse* reply) override;
+
 
   enum ServerTamperInfo
   {
@@ -72,10 +95,47 @@ public:
   };
 
 private:
-  leveldb::DB* store_;
-  std::map<size_t, std::string> vsl_; // hash(pubkey) -> VersionStruct as str
+  // An independent group of users: its own operation lock and version list.
+  // Namespaces share the blob store, so identical blobs are stored once.
+  struct Namespace {
+    std::atomic<size_t> lock{0};
+    std::mutex vsl_mu;
+    std::map<size_t, std::string> vsl; // hash(pubkey) -> VersionStruct as str
+    std::atomic<uint64_t> itable_root{0};
+
+    std::atomic<uint64_t> start_ops{0};
+    std::atomic<uint64_t> lock_conflicts{0};
+    std::atomic<uint64_t> commits{0};
+    std::atomic<uint64_t> aborts{0};
+    std::atomic<uint64_t> gets{0};
+    std::atomic<uint64_t> puts{0};
+  };
+
+  // finds or creates the namespace, the pointer stays valid for our lifetime;
+  // only StartOp may create one, so unknown ids cannot grow namespaces_
+  Namespace* GetNamespace(const std::string& id);
+  // finds the namespace, nullptr if no StartOp has created it
+  Namespace* FindNamespace(const std::string& id);
+
+  // fails an RPC that was not admitted, passing on the retry-after hint
+  Status Reject(ServerContext* context, const AdmissionController::Ticket& ticket);
+
+  std::unique_ptr<BlobStore> store_;
+  BlobCache cache_;                     // hot blobs, filled on Put and Get
+  AdmissionController admission_;
+  std::shared_mutex namespaces_mu_;
+  std::unordered_map<std::string, std::unique_ptr<Namespace>> namespaces_;
   std::hash<std::string> hasher_;
-  std::atomic<size_t> lock_;
   ServerTamperInfo tamper_info_;
   
 };
+
+// Builds and starts a server for service listening on every address in
+// addresses: "host:port" for TCP or "unix:///path/to.sock" for a Unix domain
+// socket (a stale socket file at the path is removed first; a live one, or
+// anything that is not a socket, fails the start). With no addresses
+// the server is only reachable in-process, through
+// server->InProcessChannel(fcKVChannelArguments()). Returns nullptr if a port
+// could not be bound.
+std::unique_ptr<Server> start_server(FCKVStoreRPCServiceImpl* service,
+                                     const std::vector<std::string>& addresses);
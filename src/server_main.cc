@@ -0,0 +1,88 @@
+#include "fc_kv_store.grpc.pb.h"
+
+#include <grpcpp/ext/proto_server_reflection_plugin.h>
+#include <grpcpp/grpcpp.h>
+#include <signal.h>
+#include "log.h"
+#include "server.h"
+#include "trace.h"
+
+// matches "--name=value" and stores value
+static bool ParseFlag(const std::string& arg, const std::string& name, std::string* value)
+{
+  std::string prefix = "--" + name + "=";
+  if (arg.rfind(prefix, 0) != 0) {
+    return false;
+  }
+  *value = arg.substr(prefix.size());
+  return true;
+}
+
+void run_server(const std::vector<std::string>& addresses, const std::string& engine,
+                const std::string& db_path, size_t cache_bytes, size_t max_in_flight)
+{
+  FCKVStoreRPCServiceImpl service(engine, db_path, cache_bytes, max_in_flight);
+  //  grpc::reflection::InitProtoReflectionServerBuilderPlugin();
+  std::unique_ptr<Server> server = start_server(&service, addresses);
+  if (!server) {
+    std::cerr << "Failed to start server" << std::endl;
+    std::exit(1);
+  }
+  for (auto& address : addresses) {
+    std::cout << "Server listening on " << address << std::endl;
+  }
+  std::cout << "Using " << engine << " engine, blob cache " << cache_bytes << " bytes"
+            << ", at most " << max_in_flight << " requests in flight per RPC type" << std::endl;
+
+  // Wait for the server to shutdown. Note that some other thread must be
+  // responsible for shutting down the server for this call to ever return.
+  server->Wait();
+}
+
+int main(int argc, char** argv)
+{
+  // "ctrl-C handler"
+  fc_log::ExitOnSignal(SIGINT, fc_trace::WriteChromeTraceFromEnv);
+  fc_trace::SetProcessName("simple_kv_store");
+  fc_log::SetLevelFromEnv();
+
+  // --listen=ADDR, repeatable: host:port or unix:///path/to.sock
+  // --engine=leveldb|memory|log picks the storage engine
+  // --db_path=PATH overrides the engine's default location
+  // --cache_bytes=N sets the blob cache budget, 0 disables it
+  // --log_level=debug|info|warn|error|off, overrides $FC_KV_LOG_LEVEL
+  // --max_in_flight=N caps concurrent requests per RPC type, 0 disables the cap
+  std::vector<std::string> addresses;
+  std::string engine = "leveldb";
+  std::string db_path;
+  size_t cache_bytes = BlobCache::kDefaultCapacityBytes;
+  size_t max_in_flight = AdmissionController::kDefaultMaxInFlight;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    std::string value;
+    if (ParseFlag(arg, "listen", &value)) {
+      addresses.push_back(value);
+    } else if (ParseFlag(arg, "engine", &value)) {
+      engine = value;
+    } else if (ParseFlag(arg, "db_path", &value)) {
+      db_path = value;
+    } else if (ParseFlag(arg, "cache_bytes", &value)) {
+      cache_bytes = std::stoull(value);
+    } else if (ParseFlag(arg, "max_in_flight", &value)) {
+      max_in_flight = std::stoull(value);
+    } else if (ParseFlag(arg, "log_level", &value)) {
+      if (!fc_log::SetLevelByName(value.c_str())) {
+        std::cerr << "Unknown log level " << value << std::endl;
+        return 1;
+      }
+    } else {
+      std::cerr << "Unknown flag " << arg << std::endl;
+      return 1;
+    }
+  }
+  if (addresses.empty()) {
+    addresses.push_back("localhost:50051");
+  }
+  run_server(addresses, engine, db_path, cache_bytes, max_in_flight);
+  return 0;
+}
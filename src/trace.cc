@@ -0,0 +1,121 @@
+#include "trace.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <vector>
+
+namespace fc_trace {
+
+// One ring per thread. The owning thread is the only writer; the mutex is
+// uncontended except while an export is copying the ring out.
+struct ThreadBuffer {
+  std::mutex mu;
+  uint32_t tid;
+  uint64_t next = 0;   // total events ever written
+  std::vector<Event> ring = std::vector<Event>(kRingSize);
+};
+
+static std::mutex registry_mu;
+static std::vector<std::shared_ptr<ThreadBuffer>> registry;  // outlives threads
+static std::string process_name;
+
+static thread_local uint64_t current_trace_id = 0;
+
+static ThreadBuffer* LocalBuffer() {
+  static std::atomic<uint32_t> next_tid{1};
+  thread_local std::shared_ptr<ThreadBuffer> buffer;
+  if (!buffer) {
+    buffer = std::make_shared<ThreadBuffer>();
+    buffer->tid = next_tid++;
+    std::lock_guard<std::mutex> guard(registry_mu);
+    registry.push_back(buffer);
+  }
+  return buffer.get();
+}
+
+uint64_t NowMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+           std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+uint64_t NewTraceId() {
+  thread_local std::mt19937_64 rng(std::random_device{}());
+  uint64_t id;
+  do {
+    id = rng();
+  } while (id == 0);
+  return id;
+}
+
+void SetTraceId(uint64_t trace_id) {
+  current_trace_id = trace_id;
+}
+
+uint64_t CurrentTraceId() {
+  return current_trace_id;
+}
+
+void SetProcessName(const std::string& name) {
+  std::lock_guard<std::mutex> guard(registry_mu);
+  process_name = name;
+}
+
+Span::Span(const char* name)
+  : name_(name),
+    start_us_(NowMicros()) {
+}
+
+Span::~Span() {
+  uint64_t end_us = NowMicros();
+  ThreadBuffer* buffer = LocalBuffer();
+  std::lock_guard<std::mutex> guard(buffer->mu);
+  buffer->ring[buffer->next % kRingSize] = Event{name_, start_us_, end_us - start_us_, current_trace_id};
+  buffer->next++;
+}
+
+bool WriteChromeTrace(const std::string& path) {
+  std::ofstream out(path);
+  if (!out) {
+    return false;
+  }
+  int pid = getpid();
+
+  std::lock_guard<std::mutex> guard(registry_mu);
+  out << "{\"traceEvents\":[\n";
+  out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid
+      << ",\"args\":{\"name\":\"" << (process_name.empty() ? "fc_kv" : process_name) << "\"}}";
+
+  for (auto& buffer : registry) {
+    std::vector<Event> events;
+    {
+      std::lock_guard<std::mutex> buffer_guard(buffer->mu);
+      uint64_t first = buffer->next > kRingSize ? buffer->next - kRingSize : 0;
+      for (uint64_t i = first; i < buffer->next; i++) {
+        events.push_back(buffer->ring[i % kRingSize]);
+      }
+    }
+    for (auto& e : events) {
+      out << ",\n{\"name\":\"" << e.name << "\",\"cat\":\"fc_kv\",\"ph\":\"X\""
+          << ",\"ts\":" << e.start_us << ",\"dur\":" << e.dur_us
+          << ",\"pid\":" << pid << ",\"tid\":" << buffer->tid
+          << ",\"args\":{\"trace_id\":\"" << std::hex << e.trace_id << std::dec << "\"}}";
+    }
+  }
+  out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  return out.good();
+}
+
+void WriteChromeTraceFromEnv() {
+  const char* path = std::getenv("FC_KV_TRACE_FILE");
+  if (path && *path) {
+    WriteChromeTrace(path);
+  }
+}
+
+}  // namespace fc_trace
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+// Lightweight per-phase tracing for client operations and server handlers.
+//
+// Spans are recorded into a fixed-size ring buffer owned by the calling
+// thread and exported on demand in Chrome trace-event JSON format (load the
+// file in chrome://tracing or https://ui.perfetto.dev). Timestamps are wall
+// clock microseconds, so client and server traces taken on one host line up
+// on a single timeline, and every span carries the trace id of the
+// operation it belongs to. The client sends that id to the server in gRPC
+// metadata under kTraceIdMetadataKey.
+//
+// All FC_TRACE_* macros compile to nothing unless the build defines
+// FC_KV_TRACING (cmake -DFC_KV_TRACING=ON).
+namespace fc_trace {
+
+constexpr const char* kTraceIdMetadataKey = "fc-trace-id";
+constexpr size_t kRingSize = 16384;  // events kept per thread
+
+struct Event {
+  const char* name;   // must be a string literal
+  uint64_t start_us;
+  uint64_t dur_us;
+  uint64_t trace_id;
+};
+
+// Records [construction, destruction) as one complete event.
+class Span
+{
+public:
+  explicit Span(const char* name);
+  ~Span();
+
+private:
+  const char* name_;
+  uint64_t start_us_;
+};
+
+uint64_t NowMicros();
+uint64_t NewTraceId();
+void SetTraceId(uint64_t trace_id);   // for spans started on this thread
+uint64_t CurrentTraceId();
+void SetProcessName(const std::string& name);
+
+// Writes every thread's buffered events to path. Returns false on I/O error.
+bool WriteChromeTrace(const std::string& path);
+
+// Writes to $FC_KV_TRACE_FILE if it is set.
+void WriteChromeTraceFromEnv();
+
+}  // namespace fc_trace
+
+#ifdef FC_KV_TRACING
+
+#define FC_TRACE_CONCAT_INNER(a, b) a##b
+#define FC_TRACE_CONCAT(a, b) FC_TRACE_CONCAT_INNER(a, b)
+#define FC_TRACE_SPAN(name) fc_trace::Span FC_TRACE_CONCAT(fc_trace_span_, __COUNTER__)(name)
+#define FC_TRACE_BEGIN_OP() fc_trace::SetTraceId(fc_trace::NewTraceId())
+// client side: attach the current trace id to an outgoing ClientContext
+#define FC_TRACE_INJECT(context) \
+  (context).AddMetadata(fc_trace::kTraceIdMetadataKey, std::to_string(fc_trace::CurrentTraceId()))
+// server side: adopt the caller's trace id from a ServerContext*
+#define FC_TRACE_EXTRACT(context)                                                   \
+  do {                                                                              \
+    auto fc_trace_it = (context)->client_metadata().find(fc_trace::kTraceIdMetadataKey); \
+    fc_trace::SetTraceId(fc_trace_it == (context)->client_metadata().end()          \
+                           ? 0                                                      \
+                           : std::strtoull(std::string(fc_trace_it->second.data(), \
+                                                       fc_trace_it->second.size()).c_str(), \
+                                           nullptr, 10));                           \
+  } while (0)
+
+#else
+
+#define FC_TRACE_SPAN(name) ((void)0)
+#define FC_TRACE_BEGIN_OP() ((void)0)
+#define FC_TRACE_INJECT(context) ((void)0)
+#define FC_TRACE_EXTRACT(context) ((void)0)
+
+#endif
@@ -0,0 +1,95 @@
+#include "admission.h"
+#include <gtest/gtest.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using Clock = AdmissionController::Clock;
+
+static const Clock::time_point kNoDeadline = Clock::time_point::max();
+
+TEST(AdmissionTest, ShedsOverCapWithRetryHintTest) {
+  AdmissionController admission(2);
+  std::vector<std::unique_ptr<AdmissionController::Ticket>> held;
+  for (int i = 0; i < 2; i++) {
+    held.push_back(std::make_unique<AdmissionController::Ticket>(&admission, AdmissionController::kGet, kNoDeadline));
+    ASSERT_TRUE(held.back()->admitted());
+  }
+  ASSERT_EQ(admission.in_flight(AdmissionController::kGet), 2);
+
+  {
+    AdmissionController::Ticket shed(&admission, AdmissionController::kGet, kNoDeadline);
+    ASSERT_FALSE(shed.admitted());
+    ASSERT_EQ(shed.status().error_code(), grpc::StatusCode::RESOURCE_EXHAUSTED);
+    ASSERT_GE(shed.retry_after_ms(), 1);
+  }
+  ASSERT_EQ(admission.shed(AdmissionController::kGet), 1);
+  ASSERT_EQ(admission.in_flight(AdmissionController::kGet), 2);
+
+  // caps are per RPC type
+  AdmissionController::Ticket put(&admission, AdmissionController::kPut, kNoDeadline);
+  ASSERT_TRUE(put.admitted());
+
+  held.pop_back();
+  AdmissionController::Ticket again(&admission, AdmissionController::kGet, kNoDeadline);
+  ASSERT_TRUE(again.admitted());
+  ASSERT_EQ(admission.shed(), 1);
+}
+
+TEST(AdmissionTest, AlwaysAdmitsLockReleaseTest) {
+  AdmissionController admission(1);
+  AdmissionController::Ticket commit(&admission, AdmissionController::kCommitOp, kNoDeadline);
+  AdmissionController::Ticket overCap(&admission, AdmissionController::kCommitOp, kNoDeadline);
+  ASSERT_TRUE(overCap.admitted());
+  AdmissionController::Ticket late(&admission, AdmissionController::kAbortOp,
+                                   Clock::now() - std::chrono::seconds(1));
+  ASSERT_TRUE(late.admitted());
+  ASSERT_EQ(admission.in_flight(AdmissionController::kCommitOp), 2);
+  ASSERT_EQ(admission.shed(), 0);
+  ASSERT_EQ(admission.expired(), 0);
+}
+
+TEST(AdmissionTest, ZeroCapAdmitsEverythingTest) {
+  AdmissionController admission(0);
+  std::vector<std::unique_ptr<AdmissionController::Ticket>> held;
+  for (int i = 0; i < 1000; i++) {
+    held.push_back(std::make_unique<AdmissionController::Ticket>(&admission, AdmissionController::kPut, kNoDeadline));
+    ASSERT_TRUE(held.back()->admitted());
+  }
+  ASSERT_EQ(admission.in_flight(AdmissionController::kPut), 1000);
+  held.clear();
+  ASSERT_EQ(admission.in_flight(AdmissionController::kPut), 0);
+}
+
+TEST(AdmissionTest, DropsExpiredDeadlineTest) {
+  AdmissionController admission;
+  AdmissionController::Ticket late(&admission, AdmissionController::kStartOp,
+                                   Clock::now() - std::chrono::seconds(1));
+  ASSERT_FALSE(late.admitted());
+  ASSERT_EQ(late.status().error_code(), grpc::StatusCode::DEADLINE_EXCEEDED);
+  ASSERT_EQ(late.retry_after_ms(), 0);
+  ASSERT_EQ(admission.expired(), 1);
+  ASSERT_EQ(admission.in_flight(AdmissionController::kStartOp), 0);
+}
+
+TEST(AdmissionTest, DropsDeadlineShorterThanServiceTimeTest) {
+  AdmissionController admission;
+  for (int i = 0; i < 4; i++) {
+    AdmissionController::Ticket slow(&admission, AdmissionController::kPut, kNoDeadline);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  ASSERT_GE(admission.service_time_us(AdmissionController::kPut), 20000);
+
+  AdmissionController::Ticket tight(&admission, AdmissionController::kPut,
+                                    Clock::now() + std::chrono::milliseconds(1));
+  ASSERT_EQ(tight.status().error_code(), grpc::StatusCode::DEADLINE_EXCEEDED);
+
+  AdmissionController::Ticket roomy(&admission, AdmissionController::kPut,
+                                    Clock::now() + std::chrono::seconds(10));
+  ASSERT_TRUE(roomy.admitted());
+
+  // other types have their own estimate
+  AdmissionController::Ticket get(&admission, AdmissionController::kGet,
+                                  Clock::now() + std::chrono::milliseconds(1));
+  ASSERT_TRUE(get.admitted());
+}
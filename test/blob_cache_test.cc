@@ -0,0 +1,48 @@
+#include "blob_cache.h"
+#include <gtest/gtest.h>
+#include <string>
+
+TEST(BlobCacheTest, InsertLookupTest) {
+  BlobCache cache(1 << 20);
+  std::string value;
+  ASSERT_FALSE(cache.Lookup(42, &value));
+
+  cache.Insert(42, "value42");
+  ASSERT_TRUE(cache.Lookup(42, &value));
+  ASSERT_EQ(value, "value42");
+  ASSERT_EQ(cache.hits(), 1);
+  ASSERT_EQ(cache.misses(), 1);
+
+  // re-inserting the same key replaces the value (tampered blobs do this)
+  cache.Insert(42, "");
+  ASSERT_TRUE(cache.Lookup(42, &value));
+  ASSERT_EQ(value, "");
+}
+
+TEST(BlobCacheTest, EvictsWithinBudgetTest) {
+  // one shard's worth of budget is 4KB, so a few 1KB blobs per shard fit
+  BlobCache cache(BlobCache::kNumShards * 4096);
+  std::string blob(1024, 'x');
+  for (size_t key = 0; key < 1000; key++) {
+    cache.Insert(key, blob);
+  }
+  ASSERT_LE(cache.usage_bytes(), cache.capacity_bytes());
+
+  // the most recent insert must still be there
+  std::string value;
+  ASSERT_TRUE(cache.Lookup(999, &value));
+  ASSERT_EQ(value, blob);
+}
+
+TEST(BlobCacheTest, OversizedBlobNotCachedTest) {
+  BlobCache cache(BlobCache::kNumShards * 1024);
+  cache.Insert(7, std::string(4096, 'y'));
+  std::string value;
+  ASSERT_FALSE(cache.Lookup(7, &value));
+  ASSERT_EQ(cache.usage_bytes(), 0);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,72 @@
+#include "blob_store.h"
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+class BlobStoreTest : public testing::TestWithParam<std::string> {
+protected:
+  void SetUp() override {
+    path = std::filesystem::temp_directory_path() / ("blob_store_test_" + GetParam());
+    std::filesystem::remove_all(path);
+    store = BlobStore::Open(GetParam(), path);
+    ASSERT_NE(store, nullptr);
+  }
+
+  void TearDown() override {
+    store.reset();
+    std::filesystem::remove_all(path);
+  }
+
+  std::string path;
+  std::unique_ptr<BlobStore> store;
+};
+
+TEST_P(BlobStoreTest, PutGetTest) {
+  std::string value;
+  ASSERT_FALSE(store->Get(1, &value));
+  ASSERT_FALSE(store->Contains(1));
+
+  ASSERT_TRUE(store->Put(1, "value1"));
+  ASSERT_TRUE(store->Put(2, std::string(100000, 'z')));
+  ASSERT_TRUE(store->Contains(1));
+  ASSERT_TRUE(store->Get(1, &value));
+  ASSERT_EQ(value, "value1");
+  ASSERT_TRUE(store->Get(2, &value));
+  ASSERT_EQ(value, std::string(100000, 'z'));
+}
+
+TEST_P(BlobStoreTest, OverwriteTest) {
+  std::string value;
+  ASSERT_TRUE(store->Put(1, "value1"));
+  ASSERT_TRUE(store->Put(1, "value1"));
+  ASSERT_TRUE(store->Put(1, ""));
+  ASSERT_TRUE(store->Get(1, &value));
+  ASSERT_EQ(value, "");
+}
+
+TEST_P(BlobStoreTest, ReopenTest) {
+  if (GetParam() == "memory") {
+    GTEST_SKIP() << "memory engine is not persistent";
+  }
+  ASSERT_TRUE(store->Put(1, "value1"));
+  ASSERT_TRUE(store->Put(2, "value2"));
+  ASSERT_TRUE(store->Put(1, "value1b"));
+  store.reset();
+
+  store = BlobStore::Open(GetParam(), path);
+  ASSERT_NE(store, nullptr);
+  std::string value;
+  ASSERT_TRUE(store->Get(1, &value));
+  ASSERT_EQ(value, "value1b");
+  ASSERT_TRUE(store->Get(2, &value));
+  ASSERT_EQ(value, "value2");
+}
+
+INSTANTIATE_TEST_SUITE_P(Engines, BlobStoreTest,
+                         testing::Values("leveldb", "memory", "log"));
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
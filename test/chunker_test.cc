@@ -0,0 +1,66 @@
+#include "chunker.h"
+#include <gtest/gtest.h>
+#include <random>
+#include <set>
+#include <string>
+
+static std::string RandomValue(size_t len, uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  std::string value(len, '\0');
+  for (auto& c : value) c = (char)rng();
+  return value;
+}
+
+TEST(ChunkerTest, ChunksCoverValueTest) {
+  std::string value = RandomValue(3 << 20, 1);
+  auto chunks = Chunker::Split(value);
+
+  std::string joined;
+  for (size_t i = 0; i < chunks.size(); i++) {
+    ASSERT_LE(chunks[i].size(), Chunker::kMaxChunkSize);
+    if (i + 1 < chunks.size()) {
+      ASSERT_GE(chunks[i].size(), Chunker::kMinChunkSize);
+    }
+    joined.append(chunks[i]);
+  }
+  ASSERT_EQ(joined, value);
+
+  // content defined, so splitting again gives the same chunks
+  ASSERT_EQ(Chunker::Split(value), chunks);
+}
+
+TEST(ChunkerTest, SmallAndEmptyValuesTest) {
+  ASSERT_TRUE(Chunker::Split("").empty());
+  std::string value = RandomValue(100, 2);
+  auto chunks = Chunker::Split(value);
+  ASSERT_EQ(chunks.size(), 1);
+  ASSERT_EQ(chunks[0], value);
+}
+
+TEST(ChunkerTest, InsertOnlyChangesNearbyChunksTest) {
+  std::string value = RandomValue(2 << 20, 3);
+  std::string edited = value;
+  edited.insert(value.size() / 2, "a few inserted bytes");
+
+  std::set<std::string_view> before;
+  for (auto chunk : Chunker::Split(value)) before.insert(chunk);
+  auto after = Chunker::Split(edited);
+
+  size_t changed = 0;
+  for (auto chunk : after) {
+    if (!before.count(chunk)) changed++;
+  }
+  // fixed size blocks would shift every chunk after the insert
+  ASSERT_LE(changed, 2);
+}
+
+TEST(ChunkerTest, ZerosHitMaxChunkSizeTest) {
+  std::string value(1 << 20, '\0');
+  auto chunks = Chunker::Split(value);
+  ASSERT_EQ(chunks.size(), (1 << 20) / Chunker::kMaxChunkSize);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,14 +1,47 @@
+#include "chunker.h"
 #include "customer.h"
+#include "server.h"
 #include <gtest/gtest.h>
 #include <grpcpp/grpcpp.h>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <memory>
+#include <set>
 #include <string>
 
+// Channel to the server under test, picked by $FC_KV_STORE_ENDPOINT:
+// unset or host:port or unix:///path for an already running server, or
+// "inproc" to run the store inside the test binary on the memory engine.
+static std::shared_ptr<grpc::Channel> TestChannel() {
+  std::string endpoint = defaultEndpoint();
+  if (endpoint != "inproc") {
+    return createChannel(endpoint);
+  }
+  static FCKVStoreRPCServiceImpl service("memory");
+  static std::unique_ptr<Server> server = start_server(&service, {});
+  return server->InProcessChannel(fcKVChannelArguments());
+}
+
+static ServerStatsResponse Stats(std::shared_ptr<grpc::Channel> channel, const std::string& namespaceId) {
+  ServerStatsRequest req;
+  ServerStatsResponse reply;
+  grpc::ClientContext context;
+  req.set_namespace_id(namespaceId);
+  EXPECT_TRUE(FCKVStoreRPC::NewStub(channel)->FCKVServerStats(&context, req, &reply).ok());
+  return reply;
+}
+
+// a namespace no earlier run against the same server has touched
+static std::string FreshNamespace(const std::string& prefix) {
+  return prefix + std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
+}
+
 class FCKVClientTest : public testing::Test {
 protected:
   void SetUp() override {
-    std::string server_address("localhost:50051");
-    auto channel = grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials());
+    auto channel = TestChannel();
 
     for (int i = 0; i < 2; ++i) {
         std::string pubkey = "12345" + std::to_string(i);
@@ -75,6 +108,315 @@ TEST_F(FCKVClientTest, PutGetMultipleClientsTest) {
   }
 }
 
+TEST_F(FCKVClientTest, WarmRestartFromStateDirTest) {
+  auto channel = TestChannel();
+  std::string stateDir = std::filesystem::temp_directory_path() / "fc_kv_client_state_test";
+  std::filesystem::remove_all(stateDir);
+  FCKVClientOptions options;
+  options.state_dir = stateDir;
+  options.namespace_id = "restart";
+
+  std::string k1 = "keyrestart";
+  std::string v1 = "valuerestart";
+  {
+    FCKVClient client(channel, "restart", "restart_private_key.pem", "restart_public_key.pem", options);
+    ASSERT_EQ(client.Put(k1, v1), 0);
+  }
+
+  // a new process picks up the same keys, version struct and key table, so
+  // neither the key table nor the value has to be fetched from the server
+  FCKVClient client(channel, "restart", "restart_private_key.pem", "restart_public_key.pem", options);
+  uint64_t gets = Stats(channel, "restart").gets();
+  std::pair<int, std::string> reply = client.Get(k1);
+  ASSERT_EQ(reply.first, 0);
+  ASSERT_EQ(reply.second, v1);
+  ASSERT_EQ(Stats(channel, "restart").gets(), gets);
+  std::filesystem::remove_all(stateDir);
+}
+
+TEST_F(FCKVClientTest, ChunkedPutGetTest) {
+  std::string value;
+  for (int i = 0; value.size() < (1 << 20); i++) {
+    value += "line " + std::to_string(i) + " of a large versioned document\n";
+  }
+  std::string edited = value;
+  edited.insert(edited.size() / 3, "an edit in the middle");
+
+  ASSERT_EQ(clients[0]->Put("bigkey1", value), 0);
+  ASSERT_EQ(clients[0]->Put("bigkey2", edited), 0);
+
+  std::pair<int, std::string> reply = clients[1]->Get("bigkey1");
+  ASSERT_EQ(reply.first, 0);
+  ASSERT_EQ(reply.second, value);
+  reply = clients[1]->Get("bigkey2");
+  ASSERT_EQ(reply.first, 0);
+  ASSERT_EQ(reply.second, edited);
+
+  // overwriting a chunked key with a small value goes back to a plain blob
+  ASSERT_EQ(clients[1]->Put("bigkey1", "small"), 0);
+  reply = clients[0]->Get("bigkey1");
+  ASSERT_EQ(reply.first, 0);
+  ASSERT_EQ(reply.second, "small");
+}
+
+TEST_F(FCKVClientTest, ChunkedPutUploadsOnlyNewChunksTest) {
+  auto channel = TestChannel();
+  FCKVClientOptions options;
+  options.namespace_id = FreshNamespace("dedup");
+  FCKVClient client(channel, "dedup", "dedup_private_key.pem", "dedup_public_key.pem", options);
+
+  // content no earlier run stored, the blob store is shared by all namespaces
+  std::string value;
+  for (int i = 0; value.size() < (1 << 20); i++) {
+    value += options.namespace_id + " line " + std::to_string(i) + "\n";
+  }
+  std::string edited = value;
+  edited.replace(edited.size() / 2, 5, "edit!");
+
+  std::set<size_t> chunks;
+  for (auto chunk : Chunker::Split(value)) {
+    chunks.insert(std::hash<std::string_view>()(chunk));
+  }
+  std::set<size_t> changed;
+  for (auto chunk : Chunker::Split(edited)) {
+    size_t hash = std::hash<std::string_view>()(chunk);
+    if (chunks.count(hash) == 0) {
+      changed.insert(hash);
+    }
+  }
+  ASSERT_GE(changed.size(), 1);
+  ASSERT_LE(changed.size(), 2);
+
+  // every chunk, then the manifest and the key table
+  uint64_t puts = Stats(channel, options.namespace_id).puts();
+  ASSERT_EQ(client.Put("big", value), 0);
+  ASSERT_EQ(Stats(channel, options.namespace_id).puts(), puts + chunks.size() + 2);
+
+  // only the chunks around the edit go up again
+  puts = Stats(channel, options.namespace_id).puts();
+  ASSERT_EQ(client.Put("big", edited), 0);
+  ASSERT_EQ(Stats(channel, options.namespace_id).puts(), puts + changed.size() + 2);
+
+  std::pair<int, std::string> reply = client.Get("big");
+  ASSERT_EQ(reply.first, 0);
+  ASSERT_EQ(reply.second, edited);
+}
+
+TEST_F(FCKVClientTest, NamespacesAreIndependentTest) {
+  auto channel = TestChannel();
+  FCKVClientOptions optionsA;
+  optionsA.namespace_id = "tenantA";
+  FCKVClientOptions optionsB;
+  optionsB.namespace_id = "tenantB";
+  FCKVClient clientA(channel, "tenantuserA", "tenantA_private_key.pem", "tenantA_public_key.pem", optionsA);
+  FCKVClient clientB(channel, "tenantuserB", "tenantB_private_key.pem", "tenantB_public_key.pem", optionsB);
+
+  ASSERT_EQ(clientA.Put("nskey", "valueA"), 0);
+  ASSERT_EQ(clientB.Put("nskey", "valueB"), 0);
+
+  std::pair<int, std::string> reply = clientA.Get("nskey");
+  ASSERT_EQ(reply.first, 0);
+  ASSERT_EQ(reply.second, "valueA");
+  reply = clientB.Get("nskey");
+  ASSERT_EQ(reply.first, 0);
+  ASSERT_EQ(reply.second, "valueB");
+}
+
+static std::string ReadPem(const std::string& path) {
+  std::ifstream in(path);
+  return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+TEST_F(FCKVClientTest, VerifyRejectsTamperedStructTest) {
+  // SetUp wrote client0's key files
+  VersionStruct v;
+  v.set_version(3);
+  v.set_itablehash(42);
+  v.set_pubkey(ReadPem("client0_public_key.pem"));
+  ASSERT_TRUE(signVersionStruct(&v, "client0_private_key.pem"));
+  ASSERT_TRUE(verifyVersionStruct(v));
+
+  VersionStruct badsig = v;
+  std::string signature = badsig.signature();
+  signature[signature.size() / 2] ^= 1;
+  badsig.set_signature(signature);
+  ASSERT_FALSE(verifyVersionStruct(badsig));
+
+  VersionStruct badcontent = v;
+  badcontent.set_itablehash(43);
+  ASSERT_FALSE(verifyVersionStruct(badcontent));
+
+  // signed by someone else
+  VersionStruct otherkey = v;
+  otherkey.set_pubkey(ReadPem("client1_public_key.pem"));
+  ASSERT_FALSE(verifyVersionStruct(otherkey));
+}
+
+TEST_F(FCKVClientTest, UnchangedStructIsVerifiedOnceTest) {
+  auto channel = TestChannel();
+  FCKVClientOptions options;
+  options.namespace_id = "verifyonce";
+  FCKVClient clientA(channel, "verifyonceA", "verifyonceA_private_key.pem", "verifyonceA_public_key.pem", options);
+  FCKVClient clientB(channel, "verifyonceB", "verifyonceB_private_key.pem", "verifyonceB_public_key.pem", options);
+
+  ASSERT_EQ(clientB.Put("key", "value"), 0);
+  ASSERT_EQ(clientA.Get("key").first, 0);
+  uint64_t verifications = clientA.verifications();
+  ASSERT_GE(verifications, 1);
+
+  // B's struct has not changed
+  ASSERT_EQ(clientA.Get("key").first, 0);
+  ASSERT_EQ(clientA.verifications(), verifications);
+
+  ASSERT_EQ(clientB.Put("key", "value2"), 0);
+  std::pair<int, std::string> reply = clientA.Get("key");
+  ASSERT_EQ(reply.first, 0);
+  ASSERT_EQ(reply.second, "value2");
+  ASSERT_EQ(clientA.verifications(), verifications + 1);
+}
+
+// Plays a server that rewrites user's struct in namespaceId: takes the lock
+// as user, applies edit to the stored struct and commits it back.
+static void SwapInStruct(std::shared_ptr<grpc::Channel> channel, const std::string& namespaceId,
+                         const std::string& user, const std::function<void(VersionStruct*)>& edit) {
+  auto stub = FCKVStoreRPC::NewStub(channel);
+  StartOpRequest sreq;
+  StartOpResponse sres;
+  sreq.set_pubkey(std::hash<std::string>()(user));
+  sreq.set_namespace_id(namespaceId);
+  {
+    grpc::ClientContext context;
+    ASSERT_TRUE(stub->FCKVStoreStartOp(&context, sreq, &sres).ok());
+  }
+  CommitOpRequest creq;
+  CommitOpResponse cres;
+  creq.set_pubkey(sreq.pubkey());
+  creq.set_namespace_id(namespaceId);
+  for (auto& serialized : sres.versions()) {
+    VersionStruct v;
+    v.ParseFromString(serialized);
+    if (v.pubkey() == ReadPem(user + "_public_key.pem")) {
+      *creq.mutable_v() = v;
+    }
+  }
+  ASSERT_FALSE(creq.v().signature().empty());
+  edit(creq.mutable_v());
+  grpc::ClientContext context;
+  ASSERT_TRUE(stub->FCKVStoreCommitOp(&context, creq, &cres).ok());
+}
+
+// Checks that the namespace lock is free by taking and releasing it.
+static void ExpectUnlocked(std::shared_ptr<grpc::Channel> channel, const std::string& namespaceId) {
+  auto stub = FCKVStoreRPC::NewStub(channel);
+  StartOpRequest sreq;
+  StartOpResponse sres;
+  sreq.set_pubkey(std::hash<std::string>()("lockprobe"));
+  sreq.set_namespace_id(namespaceId);
+  {
+    grpc::ClientContext context;
+    ASSERT_TRUE(stub->FCKVStoreStartOp(&context, sreq, &sres).ok());
+  }
+  AbortOpRequest areq;
+  AbortOpResponse ares;
+  areq.set_pubkey(sreq.pubkey());
+  areq.set_namespace_id(namespaceId);
+  grpc::ClientContext context;
+  ASSERT_TRUE(stub->FCKVStoreAbortOp(&context, areq, &ares).ok());
+}
+
+TEST_F(FCKVClientTest, BadSignatureAbortsOperationTest) {
+  auto channel = TestChannel();
+  FCKVClientOptions options;
+  options.namespace_id = FreshNamespace("badsig");
+  FCKVClient clientA(channel, "badsigA", "badsigA_private_key.pem", "badsigA_public_key.pem", options);
+  FCKVClient clientB(channel, "badsigB", "badsigB_private_key.pem", "badsigB_public_key.pem", options);
+  ASSERT_EQ(clientB.Put("key", "value"), 0);
+
+  // the server swaps in B's struct with a corrupted signature
+  SwapInStruct(channel, options.namespace_id, "badsigB", [](VersionStruct* v) {
+    std::string signature = v->signature();
+    signature[0] ^= 1;
+    v->set_signature(signature);
+  });
+
+  uint64_t aborts = Stats(channel, options.namespace_id).aborts();
+  std::pair<int, std::string> reply = clientA.Get("key");
+  ASSERT_EQ(reply.first, -1);
+  ASSERT_NE(reply.second, "value");
+
+  // A gave the lock back
+  ASSERT_EQ(Stats(channel, options.namespace_id).aborts(), aborts + 1);
+  ExpectUnlocked(channel, options.namespace_id);
+}
+
+TEST_F(FCKVClientTest, EditedOwnStructAbortsOperationTest) {
+  auto channel = TestChannel();
+  FCKVClientOptions options;
+  options.namespace_id = FreshNamespace("editedown");
+  FCKVClient client(channel, "editedown", "editedown_private_key.pem", "editedown_public_key.pem", options);
+  ASSERT_EQ(client.Put("key", "value"), 0);
+
+  // our own signature is left alone, only the content changes
+  SwapInStruct(channel, options.namespace_id, "editedown", [](VersionStruct* v) {
+    v->set_version(v->version() + 10);
+  });
+
+  uint64_t aborts = Stats(channel, options.namespace_id).aborts();
+  std::pair<int, std::string> reply = client.Get("key");
+  ASSERT_EQ(reply.first, -1);
+  ASSERT_NE(reply.second, "value");
+  ASSERT_EQ(Stats(channel, options.namespace_id).aborts(), aborts + 1);
+  ExpectUnlocked(channel, options.namespace_id);
+}
+
+TEST_F(FCKVClientTest, BlobNotMatchingItsHashIsRejectedTest) {
+  auto channel = TestChannel();
+  FCKVClientOptions options;
+  options.namespace_id = "badblob";
+  FCKVClient client(channel, "badblob", "badblob_private_key.pem", "badblob_public_key.pem", options);
+  std::string key = "badblobkey";
+  std::string value = "badblobvalue";
+  ASSERT_EQ(client.Put(key, value), 0);
+
+  // the server now answers H(value) with an empty blob
+  ASSERT_EQ(client.TamperInfo(key, value, 2), 0);
+  std::pair<int, std::string> reply = client.Get(key);
+  ASSERT_EQ(client.TamperInfo(key, value, 0), 0);
+  ASSERT_EQ(reply.first, -1);
+  ASSERT_NE(reply.second, "");
+}
+
+TEST_F(FCKVClientTest, FailedGetReleasesLockTest) {
+  auto channel = TestChannel();
+  FCKVClientOptions options;
+  options.namespace_id = "failedget";
+  FCKVClient client(channel, "failedget", "failedget_private_key.pem", "failedget_public_key.pem", options);
+  ASSERT_EQ(client.Put("key", "value"), 0);
+
+  uint64_t aborts = Stats(channel, "failedget").aborts();
+  ASSERT_EQ(client.Get("nosuchkey").first, -1);
+  ASSERT_EQ(Stats(channel, "failedget").aborts(), aborts + 1);
+  ASSERT_EQ(client.Get("key").second, "value");
+}
+
+TEST_F(FCKVClientTest, UnknownNamespaceIsNotCreatedTest) {
+  auto channel = TestChannel();
+  uint64_t namespaces = Stats(channel, "").namespaces();
+
+  ServerStatsResponse stats = Stats(channel, "neverstarted");
+  ASSERT_EQ(stats.start_ops(), 0);
+  ASSERT_EQ(stats.users(), 0);
+
+  // only StartOp creates a namespace, anything else is refused
+  GetRequest req;
+  GetResponse reply;
+  grpc::ClientContext context;
+  req.set_namespace_id("neverstarted");
+  Status status = FCKVStoreRPC::NewStub(channel)->FCKVStoreGet(&context, req, &reply);
+  ASSERT_EQ(status.error_code(), grpc::StatusCode::UNAVAILABLE);
+  ASSERT_EQ(Stats(channel, "").namespaces(), namespaces);
+}
+
 TEST_F(FCKVClientTest, ServerTamperHideUpdate) {
 
   std::string k1 = "keytest";
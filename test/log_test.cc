@@ -0,0 +1,97 @@
+#include "log.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Flushes and returns everything written to out since the last call.
+static std::string ReadLog(FILE* out) {
+  fc_log::Flush();
+  std::string text;
+  rewind(out);
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), out)) > 0) {
+    text.append(buf, n);
+  }
+  rewind(out);
+  ftruncate(fileno(out), 0);
+  return text;
+}
+
+class LogTest : public ::testing::Test
+{
+protected:
+  void SetUp() override {
+    out_ = tmpfile();
+    ASSERT_NE(out_, nullptr);
+    fc_log::SetOutput(out_);
+    fc_log::SetLevel(fc_log::kInfo);
+  }
+
+  void TearDown() override {
+    fc_log::SetOutput(stderr);
+    fclose(out_);
+  }
+
+  FILE* out_;
+};
+
+TEST_F(LogTest, LinesFromAllThreadsArriveInOrderTest) {
+  const int kThreads = 8;
+  const int kLines = 200;   // below kRingSlots, so nothing is dropped
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([t] {
+      for (int i = 0; i < kLines; i++) {
+        FC_LOG(kInfo) << "thread " << t << " line " << i;
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  std::istringstream lines(ReadLog(out_));
+  std::map<int, int> next;
+  std::string line;
+  while (std::getline(lines, line)) {
+    ASSERT_EQ(line[0], 'I');
+    int t, i;
+    ASSERT_EQ(sscanf(line.substr(line.find("] ") + 2).c_str(), "thread %d line %d", &t, &i), 2);
+    ASSERT_EQ(i, next[t]++);
+  }
+  ASSERT_EQ(next.size(), kThreads);
+  for (auto& [t, count] : next) {
+    ASSERT_EQ(count, kLines);
+  }
+}
+
+TEST_F(LogTest, DisabledLevelSkipsArgumentsTest) {
+  int evaluated = 0;
+  auto count = [&] { return ++evaluated; };
+
+  FC_LOG(kDebug) << count();
+  ASSERT_EQ(evaluated, 0);
+  FC_LOG(kWarn) << count();
+  ASSERT_EQ(evaluated, 1);
+
+  ASSERT_TRUE(fc_log::SetLevelByName("off"));
+  FC_LOG(kError) << count();
+  ASSERT_EQ(evaluated, 1);
+  ASSERT_FALSE(fc_log::SetLevelByName("loud"));
+
+  std::string text = ReadLog(out_);
+  ASSERT_EQ(text[0], 'W');
+  ASSERT_EQ(text.find('\n'), text.size() - 1);
+}
+
+TEST_F(LogTest, LongLinesAreTruncatedTest) {
+  FC_LOG(kError) << std::string(4 * fc_log::kMaxLineSize, 'x');
+  std::string text = ReadLog(out_);
+  std::string message = text.substr(text.find("] ") + 2);
+  ASSERT_EQ(message, std::string(fc_log::kMaxLineSize, 'x') + "\n");
+}
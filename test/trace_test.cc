@@ -0,0 +1,67 @@
+#include "customer.h"
+#include "server.h"
+#include "trace.h"
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+
+#ifndef FC_KV_TRACING
+#error "trace_test links traced_lib, which builds with FC_KV_TRACING"
+#endif
+
+// the quoted value after "key":" on a trace event line
+static std::string Field(const std::string& line, const std::string& key) {
+  std::string prefix = "\"" + key + "\":\"";
+  size_t start = line.find(prefix);
+  if (start == std::string::npos) {
+    return "";
+  }
+  start += prefix.size();
+  return line.substr(start, line.find('"', start) - start);
+}
+
+TEST(TraceTest, ClientAndServerSpansShareTraceIdTest) {
+  FCKVStoreRPCServiceImpl service("memory");
+  std::unique_ptr<Server> server = start_server(&service, {});
+  ASSERT_NE(server, nullptr);
+  FCKVClient client(server->InProcessChannel(fcKVChannelArguments()), "trace",
+                    "trace_private_key.pem", "trace_public_key.pem");
+  ASSERT_EQ(client.Put("tracekey", "tracevalue"), 0);
+  ASSERT_EQ(client.Get("tracekey").second, "tracevalue");
+
+  std::string path = std::filesystem::temp_directory_path() / "fc_kv_trace_test.json";
+  ASSERT_TRUE(fc_trace::WriteChromeTrace(path));
+  std::ifstream in(path);
+  std::string line;
+  ASSERT_TRUE(std::getline(in, line));
+  ASSERT_EQ(line, "{\"traceEvents\":[");
+
+  // trace ids by span name; one event per line
+  std::map<std::string, std::set<std::string>> ids;
+  while (std::getline(in, line)) {
+    std::string name = Field(line, "name");
+    std::string id = Field(line, "trace_id");
+    if (!name.empty() && !id.empty()) {
+      ids[name].insert(id);
+    }
+  }
+  std::filesystem::remove(path);
+
+  // each op runs under its own id, which the server handlers adopt from the
+  // fc-trace-id metadata
+  ASSERT_EQ(ids["Put"].size(), 1);
+  ASSERT_EQ(ids["Get"].size(), 1);
+  std::string put = *ids["Put"].begin();
+  std::string get = *ids["Get"].begin();
+  ASSERT_NE(put, "0");
+  ASSERT_NE(put, get);
+  for (auto& span : {"Server.StartOp", "Server.Put", "Server.CommitOp"}) {
+    ASSERT_EQ(ids[span].count(put), 1) << span;
+  }
+  for (auto& span : {"Server.StartOp", "Server.Get", "Server.CommitOp"}) {
+    ASSERT_EQ(ids[span].count(get), 1) << span;
+  }
+}